@@ -1,6 +1,9 @@
+// Texture with the image to show
+uniform sampler2D u_texture;
+
 varying vec2 v_uv;
 
 void main()
 {
-	gl_FragColor = ...;
+	gl_FragColor = texture2D( u_texture, v_uv );
 }
@@ -5,5 +5,6 @@ void main()
 	// Remember the UV's range [0.0, 1.0]
 	v_uv = gl_MultiTexCoord0.xy;
 
-	gl_Position = ...;
-}
\ No newline at end of file
+	// The quad vertices are already in clip space [-1, 1]
+	gl_Position = vec4( gl_Vertex.xy, 0.0, 1.0 );
+}
@@ -1,515 +1,624 @@
 #include "picopng.h"
 
-int decodePNG(std::vector<unsigned char>& out_image, unsigned int& image_width, unsigned int& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32)
-{
-	// picoPNG version 20101224
-	// Copyright (c) 2005-2010 Lode Vandevenne
-	//
-	// This software is provided 'as-is', without any express or implied
-	// warranty. In no event will the authors be held liable for any damages
-	// arising from the use of this software.
-	//
-	// Permission is granted to anyone to use this software for any purpose,
-	// including commercial applications, and to alter it and redistribute it
-	// freely, subject to the following restrictions:
-	//
-	//     1. The origin of this software must not be misrepresented; you must not
-	//     claim that you wrote the original software. If you use this software
-	//     in a product, an acknowledgment in the product documentation would be
-	//     appreciated but is not required.
-	//     2. Altered source versions must be plainly marked as such, and must not be
-	//     misrepresented as being the original software.
-	//     3. This notice may not be removed or altered from any source distribution.
+#include <stdlib.h>
+
+// picoPNG version 20101224
+// Copyright (c) 2005-2010 Lode Vandevenne
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//     2. Altered source versions must be plainly marked as such, and must not be
+//     misrepresented as being the original software.
+//     3. This notice may not be removed or altered from any source distribution.
+
+// picoPNG is a PNG decoder in one C++ function of around 500 lines. Use picoPNG for
+// programs that need only 1 .cpp file. Since it's a single function, it's very limited,
+// it can convert a PNG to raw pixel data either converted to 32-bit RGBA color or
+// with no color conversion at all. For anything more complex, another tiny library
+// is available: LodePNG (lodepng.c(pp)), which is a single source and header file.
+// Apologies for the compact code style, it's to make this tiny.
+
+// ALTERED VERSION (not the original picoPNG):
+// - The zlib stream is read through a 64 bit buffer and the Huffman codes are decoded with a lookup table instead of a tree walk
+// - The scanlines are unfiltered a whole pixel at a time so the compiler can unroll and vectorize the channels
+// - A second entry point decodes the rows straight into an RGB buffer (optionally bottom-up) without intermediate images
+// - The structs are at file scope so both entry points share them
 
-	// picoPNG is a PNG decoder in one C++ function of around 500 lines. Use picoPNG for
-	// programs that need only 1 .cpp file. Since it's a single function, it's very limited,
-	// it can convert a PNG to raw pixel data either converted to 32-bit RGBA color or
-	// with no color conversion at all. For anything more complex, another tiny library
-	// is available: LodePNG (lodepng.c(pp)), which is a single source and header file.
-	// Apologies for the compact code style, it's to make this tiny.
+namespace {
 
-	static const unsigned long LENBASE[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
-	static const unsigned long LENEXTRA[29] = { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
-	static const unsigned long DISTBASE[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
-	static const unsigned long DISTEXTRA[30] = { 0,0,0,0,1,1,2, 2, 3, 3, 4, 4, 5, 5,  6,  6,  7,  7,  8,  8,   9,   9,  10,  10,  11,  11,  12,   12,   13,   13 };
-	static const unsigned long CLCL[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 }; //code length code lengths
-	struct Zlib //nested functions for zlib decompression
+static const unsigned long LENBASE[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const unsigned long LENEXTRA[29] = { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
+static const unsigned long DISTBASE[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const unsigned long DISTEXTRA[30] = { 0,0,0,0,1,1,2, 2, 3, 3, 4, 4, 5, 5,  6,  6,  7,  7,  8,  8,   9,   9,  10,  10,  11,  11,  12,   12,   13,   13 };
+static const unsigned long CLCL[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 }; //code length code lengths
+
+struct Zlib //nested functions for zlib decompression
+{
+	struct BitReader //the bits of the stream, least significant first, are kept in a 64 bit buffer refilled a byte at a time
 	{
-		static unsigned long readBitFromStream(size_t& bitp, const unsigned char* bits) { unsigned long result = (bits[bitp >> 3] >> (bitp & 0x7)) & 1; bitp++; return result; }
-		static unsigned long readBitsFromStream(size_t& bitp, const unsigned char* bits, size_t nbits)
-		{
-			unsigned long result = 0;
-			for (size_t i = 0; i < nbits; i++) result += (readBitFromStream(bitp, bits)) << i;
-			return result;
+		const unsigned char* data; size_t size, pos; unsigned long long buffer; unsigned int count;
+		void init(const unsigned char* data_, size_t size_) { data = data_; size = size_; pos = 0; buffer = 0; count = 0; }
+		void refill() { while (count <= 56) { unsigned long long byte = pos < size ? data[pos] : 0; pos++; buffer |= byte << count; count += 8; } } //past the end it reads zeros
+		unsigned long read(unsigned int nbits) { if (count < nbits) refill(); unsigned long result = (unsigned long)(buffer & ((1ULL << nbits) - 1)); buffer >>= nbits; count -= nbits; return result; }
+		size_t bitsUsed() const { return pos * 8 - count; }
+		bool overrun() const { return bitsUsed() > size * 8; } //more bits used than the stream has
+	};
+	struct HuffmanTree
+	{
+		enum { FASTBITS = 10 }; //codes up to this length are decoded with one lookup
+		std::vector<unsigned short> fast; //indexed by the next FASTBITS bits of the stream: symbol << 4 | code length, 0 for the longer codes
+		unsigned short counts[16]; //number of codes of every length
+		std::vector<unsigned short> symbols; //symbols sorted by code, for the codes longer than FASTBITS
+		int makeFromLengths(const std::vector<unsigned long>& bitlen, unsigned long maxbitlen)
+		{ //make the tables given the lengths
+			unsigned long numcodes = (unsigned long)(bitlen.size());
+			for (int i = 0; i < 16; i++) counts[i] = 0;
+			for (unsigned long n = 0; n < numcodes; n++) { if (bitlen[n] > maxbitlen) return 55; counts[bitlen[n]]++; }
+			counts[0] = 0;
+			long left = 1; //codes still available, more codes than possible is an error
+			for (int len = 1; len < 16; len++) { left <<= 1; left -= counts[len]; if (left < 0) return 55; }
+			unsigned short offsets[16]; offsets[1] = 0;
+			for (int len = 1; len < 15; len++) offsets[len + 1] = offsets[len] + counts[len];
+			symbols.resize(numcodes);
+			for (unsigned long n = 0; n < numcodes; n++) if (bitlen[n] != 0) symbols[offsets[bitlen[n]]++] = (unsigned short)n;
+			fast.assign(1 << FASTBITS, 0);
+			unsigned long code = 0, index = 0; //canonical codes: consecutive values per length, in the order of the symbols
+			for (unsigned long len = 1; len <= FASTBITS; len++, code <<= 1)
+				for (unsigned long k = 0; k < counts[len]; k++, code++, index++)
+				{
+					unsigned long reversed = 0; //the codes are stored most significant bit first
+					for (unsigned long b = 0; b < len; b++) reversed |= ((code >> b) & 1) << (len - 1 - b);
+					for (unsigned long fill = reversed; fill < (1u << FASTBITS); fill += (1u << len)) fast[fill] = (unsigned short)((symbols[index] << 4) | len);
+				}
+			return 0;
 		}
-		struct HuffmanTree
+	};
+	struct Inflator
+	{
+		int error;
+		BitReader br;
+		void inflate(std::vector<unsigned char>& out, const std::vector<unsigned char>& in, size_t inpos = 0)
 		{
-			int makeFromLengths(const std::vector<unsigned long>& bitlen, unsigned long maxbitlen)
-			{ //make tree given the lengths
-				unsigned long numcodes = (unsigned long)(bitlen.size()), treepos = 0, nodefilled = 0;
-				std::vector<unsigned long> tree1d(numcodes), blcount(maxbitlen + 1, 0), nextcode(maxbitlen + 1, 0);
-				for (unsigned long bits = 0; bits < numcodes; bits++) blcount[bitlen[bits]]++; //count number of instances of each code length
-				for (unsigned long bits = 1; bits <= maxbitlen; bits++) nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
-				for (unsigned long n = 0; n < numcodes; n++) if (bitlen[n] != 0) tree1d[n] = nextcode[bitlen[n]]++; //generate all the codes
-				tree2d.clear(); tree2d.resize(numcodes * 2, 32767); //32767 here means the tree2d isn't filled there yet
-				for (unsigned long n = 0; n < numcodes; n++) //the codes
-					for (unsigned long i = 0; i < bitlen[n]; i++) //the bits for this code
-					{
-						unsigned long bit = (tree1d[n] >> (bitlen[n] - i - 1)) & 1;
-						if (treepos > numcodes - 2) return 55;
-						if (tree2d[2 * treepos + bit] == 32767) //not yet filled in
-						{
-							if (i + 1 == bitlen[n]) { tree2d[2 * treepos + bit] = n; treepos = 0; } //last bit
-							else { tree2d[2 * treepos + bit] = ++nodefilled + numcodes; treepos = nodefilled; } //addresses are encoded as values > numcodes
-						}
-						else treepos = tree2d[2 * treepos + bit] - numcodes; //subtract numcodes from address to get address value
-					}
-				return 0;
-			}
-			int decode(bool& decoded, unsigned long& result, size_t& treepos, unsigned long bit) const
-			{ //Decodes a symbol from the tree
-				unsigned long numcodes = (unsigned long)tree2d.size() / 2;
-				if (treepos >= numcodes) return 11; //error: you appeared outside the codetree
-				result = tree2d[2 * treepos + bit];
-				decoded = (result < numcodes);
-				treepos = decoded ? 0 : result - numcodes;
-				return 0;
+			size_t pos = 0; //byte position in the out buffer
+			error = 0;
+			br.init(&in[inpos], in.size() - inpos);
+			unsigned long BFINAL = 0;
+			while (!BFINAL && !error)
+			{
+				if (br.overrun()) { error = 52; return; } //error, bit pointer will jump past memory
+				BFINAL = br.read(1);
+				unsigned long BTYPE = br.read(2);
+				if (BTYPE == 3) { error = 20; return; } //error: invalid BTYPE
+				else if (BTYPE == 0) inflateNoCompression(out, pos);
+				else inflateHuffmanBlock(out, pos, BTYPE);
 			}
-			std::vector<unsigned long> tree2d; //2D representation of a huffman tree: The one dimension is "0" or "1", the other contains all nodes and leaves of the tree.
-		};
-		struct Inflator
+			if (!error) out.resize(pos); //Only now we know the true size of out, resize it to that
+		}
+		void generateFixedTrees(HuffmanTree& tree, HuffmanTree& treeD) //get the tree of a deflated block with fixed tree
 		{
-			int error;
-			void inflate(std::vector<unsigned char>& out, const std::vector<unsigned char>& in, size_t inpos = 0)
+			std::vector<unsigned long> bitlen(288, 8), bitlenD(32, 5);
+			for (size_t i = 144; i <= 255; i++) bitlen[i] = 9;
+			for (size_t i = 256; i <= 279; i++) bitlen[i] = 7;
+			tree.makeFromLengths(bitlen, 15);
+			treeD.makeFromLengths(bitlenD, 15);
+		}
+		HuffmanTree codetree, codetreeD, codelengthcodetree; //the code tree for Huffman codes, dist codes, and code length codes
+		unsigned long huffmanDecodeSymbol(const HuffmanTree& codetree)
+		{ //decode a single symbol from the stream with given code tree. return value is the symbol
+			if (br.count < 16) br.refill();
+			unsigned short entry = codetree.fast[br.buffer & ((1 << HuffmanTree::FASTBITS) - 1)];
+			if (entry) { br.buffer >>= (entry & 15); br.count -= (entry & 15); return entry >> 4; }
+			//longer code: walk the lengths comparing with the first code of every length
+			unsigned long code = 0, first = 0, index = 0;
+			for (int len = 1; len < 16; len++)
 			{
-				size_t bp = 0, pos = 0; //bit pointer and byte pointer
-				error = 0;
-				unsigned long BFINAL = 0;
-				while (!BFINAL && !error)
-				{
-					if (bp >> 3 >= in.size()) { error = 52; return; } //error, bit pointer will jump past memory
-					BFINAL = readBitFromStream(bp, &in[inpos]);
-					unsigned long BTYPE = readBitFromStream(bp, &in[inpos]); BTYPE += 2 * readBitFromStream(bp, &in[inpos]);
-					if (BTYPE == 3) { error = 20; return; } //error: invalid BTYPE
-					else if (BTYPE == 0) inflateNoCompression(out, &in[inpos], bp, pos, in.size());
-					else inflateHuffmanBlock(out, &in[inpos], bp, pos, in.size(), BTYPE);
-				}
-				if (!error) out.resize(pos); //Only now we know the true size of out, resize it to that
+				code |= (unsigned long)((br.buffer >> (len - 1)) & 1);
+				unsigned long count = codetree.counts[len];
+				if (code - first < count) { br.buffer >>= len; br.count -= len; return codetree.symbols[index + code - first]; }
+				index += count; first += count; first <<= 1; code <<= 1;
 			}
-			void generateFixedTrees(HuffmanTree& tree, HuffmanTree& treeD) //get the tree of a deflated block with fixed tree
+			error = 11; return 0; //error: the bits are not a code of the tree
+		}
+		void getTreeInflateDynamic(HuffmanTree& tree, HuffmanTree& treeD)
+		{ //get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree
+			std::vector<unsigned long> bitlen(288, 0), bitlenD(32, 0);
+			if (br.bitsUsed() + 14 > br.size * 8) { error = 49; return; } //the bit pointer is or will go past the memory
+			size_t HLIT = br.read(5) + 257; //number of literal/length codes + 257
+			size_t HDIST = br.read(5) + 1; //number of dist codes + 1
+			size_t HCLEN = br.read(4) + 4; //number of code length codes + 4
+			std::vector<unsigned long> codelengthcode(19); //lengths of tree to decode the lengths of the dynamic tree
+			for (size_t i = 0; i < 19; i++) codelengthcode[CLCL[i]] = (i < HCLEN) ? br.read(3) : 0;
+			error = codelengthcodetree.makeFromLengths(codelengthcode, 7); if (error) return;
+			size_t i = 0, replength;
+			while (i < HLIT + HDIST)
 			{
-				std::vector<unsigned long> bitlen(288, 8), bitlenD(32, 5);;
-				for (size_t i = 144; i <= 255; i++) bitlen[i] = 9;
-				for (size_t i = 256; i <= 279; i++) bitlen[i] = 7;
-				tree.makeFromLengths(bitlen, 15);
-				treeD.makeFromLengths(bitlenD, 15);
-			}
-			HuffmanTree codetree, codetreeD, codelengthcodetree; //the code tree for Huffman codes, dist codes, and code length codes
-			unsigned long huffmanDecodeSymbol(const unsigned char* in, size_t& bp, const HuffmanTree& codetree, size_t inlength)
-			{ //decode a single symbol from given list of bits with given code tree. return value is the symbol
-				bool decoded; unsigned long ct;
-				for (size_t treepos = 0;;)
-				{
-					if ((bp & 0x07) == 0 && (bp >> 3) > inlength) { error = 10; return 0; } //error: end reached without endcode
-					error = codetree.decode(decoded, ct, treepos, readBitFromStream(bp, in)); if (error) return 0; //stop, an error happened
-					if (decoded) return ct;
-				}
-			}
-			void getTreeInflateDynamic(HuffmanTree& tree, HuffmanTree& treeD, const unsigned char* in, size_t& bp, size_t inlength)
-			{ //get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree
-				std::vector<unsigned long> bitlen(288, 0), bitlenD(32, 0);
-				if (bp >> 3 >= inlength - 2) { error = 49; return; } //the bit pointer is or will go past the memory
-				size_t HLIT = readBitsFromStream(bp, in, 5) + 257; //number of literal/length codes + 257
-				size_t HDIST = readBitsFromStream(bp, in, 5) + 1; //number of dist codes + 1
-				size_t HCLEN = readBitsFromStream(bp, in, 4) + 4; //number of code length codes + 4
-				std::vector<unsigned long> codelengthcode(19); //lengths of tree to decode the lengths of the dynamic tree
-				for (size_t i = 0; i < 19; i++) codelengthcode[CLCL[i]] = (i < HCLEN) ? readBitsFromStream(bp, in, 3) : 0;
-				error = codelengthcodetree.makeFromLengths(codelengthcode, 7); if (error) return;
-				size_t i = 0, replength;
-				while (i < HLIT + HDIST)
+				unsigned long code = huffmanDecodeSymbol(codelengthcodetree); if (error) return;
+				if (br.overrun()) { error = 50; return; } //error, bit pointer jumps past memory
+				if (code <= 15) { if (i < HLIT) bitlen[i++] = code; else bitlenD[i++ - HLIT] = code; } //a length code
+				else if (code == 16) //repeat previous
 				{
-					unsigned long code = huffmanDecodeSymbol(in, bp, codelengthcodetree, inlength); if (error) return;
-					if (code <= 15) { if (i < HLIT) bitlen[i++] = code; else bitlenD[i++ - HLIT] = code; } //a length code
-					else if (code == 16) //repeat previous
+					if (i == 0) { error = 54; return; } //error: there is no previous length to repeat
+					replength = 3 + br.read(2);
+					unsigned long value; //set value to the previous code
+					if ((i - 1) < HLIT) value = bitlen[i - 1];
+					else value = bitlenD[i - HLIT - 1];
+					for (size_t n = 0; n < replength; n++) //repeat this value in the next lengths
 					{
-						if (bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-						replength = 3 + readBitsFromStream(bp, in, 2);
-						unsigned long value; //set value to the previous code
-						if ((i - 1) < HLIT) value = bitlen[i - 1];
-						else value = bitlenD[i - HLIT - 1];
-						for (size_t n = 0; n < replength; n++) //repeat this value in the next lengths
-						{
-							if (i >= HLIT + HDIST) { error = 13; return; } //error: i is larger than the amount of codes
-							if (i < HLIT) bitlen[i++] = value; else bitlenD[i++ - HLIT] = value;
-						}
+						if (i >= HLIT + HDIST) { error = 13; return; } //error: i is larger than the amount of codes
+						if (i < HLIT) bitlen[i++] = value; else bitlenD[i++ - HLIT] = value;
 					}
-					else if (code == 17) //repeat "0" 3-10 times
-					{
-						if (bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-						replength = 3 + readBitsFromStream(bp, in, 3);
-						for (size_t n = 0; n < replength; n++) //repeat this value in the next lengths
-						{
-							if (i >= HLIT + HDIST) { error = 14; return; } //error: i is larger than the amount of codes
-							if (i < HLIT) bitlen[i++] = 0; else bitlenD[i++ - HLIT] = 0;
-						}
-					}
-					else if (code == 18) //repeat "0" 11-138 times
-					{
-						if (bp >> 3 >= inlength) { error = 50; return; } //error, bit pointer jumps past memory
-						replength = 11 + readBitsFromStream(bp, in, 7);
-						for (size_t n = 0; n < replength; n++) //repeat this value in the next lengths
-						{
-							if (i >= HLIT + HDIST) { error = 15; return; } //error: i is larger than the amount of codes
-							if (i < HLIT) bitlen[i++] = 0; else bitlenD[i++ - HLIT] = 0;
-						}
-					}
-					else { error = 16; return; } //error: somehow an unexisting code appeared. This can never happen.
 				}
-				if (bitlen[256] == 0) { error = 64; return; } //the length of the end code 256 must be larger than 0
-				error = tree.makeFromLengths(bitlen, 15); if (error) return; //now we've finally got HLIT and HDIST, so generate the code trees, and the function is done
-				error = treeD.makeFromLengths(bitlenD, 15); if (error) return;
-			}
-			void inflateHuffmanBlock(std::vector<unsigned char>& out, const unsigned char* in, size_t& bp, size_t& pos, size_t inlength, unsigned long btype)
-			{
-				if (btype == 1) { generateFixedTrees(codetree, codetreeD); }
-				else if (btype == 2) { getTreeInflateDynamic(codetree, codetreeD, in, bp, inlength); if (error) return; }
-				for (;;)
+				else if (code == 17) //repeat "0" 3-10 times
 				{
-					unsigned long code = huffmanDecodeSymbol(in, bp, codetree, inlength); if (error) return;
-					if (code == 256) return; //end code
-					else if (code <= 255) //literal symbol
+					replength = 3 + br.read(3);
+					for (size_t n = 0; n < replength; n++) //repeat this value in the next lengths
 					{
-						if (pos >= out.size()) out.resize((pos + 1) * 2); //reserve more room
-						out[pos++] = (unsigned char)(code);
+						if (i >= HLIT + HDIST) { error = 14; return; } //error: i is larger than the amount of codes
+						if (i < HLIT) bitlen[i++] = 0; else bitlenD[i++ - HLIT] = 0;
 					}
-					else if (code >= 257 && code <= 285) //length code
+				}
+				else if (code == 18) //repeat "0" 11-138 times
+				{
+					replength = 11 + br.read(7);
+					for (size_t n = 0; n < replength; n++) //repeat this value in the next lengths
 					{
-						size_t length = LENBASE[code - 257], numextrabits = LENEXTRA[code - 257];
-						if ((bp >> 3) >= inlength) { error = 51; return; } //error, bit pointer will jump past memory
-						length += readBitsFromStream(bp, in, numextrabits);
-						unsigned long codeD = huffmanDecodeSymbol(in, bp, codetreeD, inlength); if (error) return;
-						if (codeD > 29) { error = 18; return; } //error: invalid dist code (30-31 are never used)
-						unsigned long dist = DISTBASE[codeD], numextrabitsD = DISTEXTRA[codeD];
-						if ((bp >> 3) >= inlength) { error = 51; return; } //error, bit pointer will jump past memory
-						dist += readBitsFromStream(bp, in, numextrabitsD);
-						size_t start = pos, back = start - dist; //backwards
-						if (pos + length >= out.size()) out.resize((pos + length) * 2); //reserve more room
-						for (size_t i = 0; i < length; i++) { out[pos++] = out[back++]; if (back >= start) back = start - dist; }
+						if (i >= HLIT + HDIST) { error = 15; return; } //error: i is larger than the amount of codes
+						if (i < HLIT) bitlen[i++] = 0; else bitlenD[i++ - HLIT] = 0;
 					}
 				}
+				else { error = 16; return; } //error: somehow an unexisting code appeared. This can never happen.
 			}
-			void inflateNoCompression(std::vector<unsigned char>& out, const unsigned char* in, size_t& bp, size_t& pos, size_t inlength)
+			if (bitlen[256] == 0) { error = 64; return; } //the length of the end code 256 must be larger than 0
+			error = tree.makeFromLengths(bitlen, 15); if (error) return; //now we've finally got HLIT and HDIST, so generate the code trees, and the function is done
+			error = treeD.makeFromLengths(bitlenD, 15); if (error) return;
+		}
+		void inflateHuffmanBlock(std::vector<unsigned char>& out, size_t& pos, unsigned long btype)
+		{
+			if (btype == 1) { generateFixedTrees(codetree, codetreeD); }
+			else if (btype == 2) { getTreeInflateDynamic(codetree, codetreeD); if (error) return; }
+			for (;;)
 			{
-				while ((bp & 0x7) != 0) bp++; //go to first boundary of byte
-				size_t p = bp / 8;
-				if (p >= inlength - 4) { error = 52; return; } //error, bit pointer will jump past memory
-				unsigned long LEN = in[p] + 256 * in[p + 1], NLEN = in[p + 2] + 256 * in[p + 3]; p += 4;
-				if (LEN + NLEN != 65535) { error = 21; return; } //error: NLEN is not one's complement of LEN
-				if (pos + LEN >= out.size()) out.resize(pos + LEN);
-				if (p + LEN > inlength) { error = 23; return; } //error: reading outside of in buffer
-				for (unsigned long n = 0; n < LEN; n++) out[pos++] = in[p++]; //read LEN bytes of literal data
-				bp = p * 8;
+				unsigned long code = huffmanDecodeSymbol(codetree); if (error) return;
+				if (br.overrun()) { error = 10; return; } //error: end reached without endcode
+				if (code == 256) return; //end code
+				else if (code <= 255) //literal symbol
+				{
+					if (pos >= out.size()) out.resize((pos + 1) * 2); //reserve more room
+					out[pos++] = (unsigned char)(code);
+				}
+				else if (code >= 257 && code <= 285) //length code
+				{
+					size_t length = LENBASE[code - 257] + br.read(LENEXTRA[code - 257]);
+					unsigned long codeD = huffmanDecodeSymbol(codetreeD); if (error) return;
+					if (codeD > 29) { error = 18; return; } //error: invalid dist code (30-31 are never used)
+					unsigned long dist = DISTBASE[codeD] + br.read(DISTEXTRA[codeD]);
+					if (br.overrun()) { error = 51; return; } //error, bit pointer will jump past memory
+					if (dist > pos) { error = 52; return; } //error: the distance goes back before the start of the data
+					if (pos + length >= out.size()) out.resize((pos + length) * 2); //reserve more room
+					unsigned char* o = &out[0];
+					if (dist >= length) memcpy(o + pos, o + pos - dist, length); //the copy does not overlap
+					else for (size_t i = 0; i < length; i++) o[pos + i] = o[pos + i - dist]; //repeats the last dist bytes
+					pos += length;
+				}
+				else { error = 16; return; } //error: codes 286 and 287 are never used
 			}
-		};
-		int decompress(std::vector<unsigned char>& out, const std::vector<unsigned char>& in) //returns error value
+		}
+		void inflateNoCompression(std::vector<unsigned char>& out, size_t& pos)
 		{
-			Inflator inflator;
-			if (in.size() < 2) { return 53; } //error, size of zlib data too small
-			if ((in[0] * 256 + in[1]) % 31 != 0) { return 24; } //error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way
-			unsigned long CM = in[0] & 15, CINFO = (in[0] >> 4) & 15, FDICT = (in[1] >> 5) & 1;
-			if (CM != 8 || CINFO > 7) { return 25; } //error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec
-			if (FDICT != 0) { return 26; } //error: the specification of PNG says about the zlib stream: "The additional flags shall not specify a preset dictionary."
-			inflator.inflate(out, in, 2);
-			return inflator.error; //note: adler32 checksum was skipped and ignored
+			size_t p = (br.bitsUsed() + 7) / 8; //go to first boundary of byte
+			if (p + 4 > br.size) { error = 52; return; } //error, bit pointer will jump past memory
+			const unsigned char* in = br.data;
+			unsigned long LEN = in[p] + 256 * in[p + 1], NLEN = in[p + 2] + 256 * in[p + 3]; p += 4;
+			if (LEN + NLEN != 65535) { error = 21; return; } //error: NLEN is not one's complement of LEN
+			if (p + LEN > br.size) { error = 23; return; } //error: reading outside of in buffer
+			if (pos + LEN >= out.size()) out.resize(pos + LEN);
+			if (LEN) memcpy(&out[pos], in + p, LEN); //read LEN bytes of literal data
+			pos += LEN; p += LEN;
+			br.pos = p; br.buffer = 0; br.count = 0; //continue reading after the data
 		}
 	};
-	struct PNG //nested functions for PNG decoding
+	int decompress(std::vector<unsigned char>& out, const std::vector<unsigned char>& in) //returns error value
+	{
+		Inflator inflator;
+		if (in.size() < 2) { return 53; } //error, size of zlib data too small
+		if ((in[0] * 256 + in[1]) % 31 != 0) { return 24; } //error: 256 * in[0] + in[1] must be a multiple of 31, the FCHECK value is supposed to be made that way
+		unsigned long CM = in[0] & 15, CINFO = (in[0] >> 4) & 15, FDICT = (in[1] >> 5) & 1;
+		if (CM != 8 || CINFO > 7) { return 25; } //error: only compression method 8: inflate with sliding window of 32k is supported by the PNG spec
+		if (FDICT != 0) { return 26; } //error: the specification of PNG says about the zlib stream: "The additional flags shall not specify a preset dictionary."
+		inflator.inflate(out, in, 2);
+		return inflator.error; //note: adler32 checksum was skipped and ignored
+	}
+};
+
+//Paeth predictor, used by PNG filter type 4. |p-a| = |b-c|, |p-b| = |a-c| and |p-c| = |a+b-2c| so p is never computed
+static inline unsigned char paethPredictor(int a, int b, int c)
+{
+	int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+	return (unsigned char)((pa <= pb && pa <= pc) ? a : pb <= pc ? b : c);
+}
+
+//Sub, Average and Paeth depend on the pixel on the left, the N bytes of a pixel are independent so the inner loops can run as one vector operation
+//precon is the previous reconstructed line (zeros for the first one)
+template <int N>
+static int unfilterPixels(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, unsigned long filterType, size_t length)
+{
+	switch (filterType)
+	{
+	case 0: memcpy(recon, scanline, length); break;
+	case 1:
+		for (size_t i = 0; i < N; i++) recon[i] = scanline[i];
+		for (size_t i = N; i < length; i += N) for (int c = 0; c < N; c++) recon[i + c] = scanline[i + c] + recon[i + c - N];
+		break;
+	case 2: for (size_t i = 0; i < length; i++) recon[i] = scanline[i] + precon[i]; break;
+	case 3:
+		for (size_t i = 0; i < N; i++) recon[i] = scanline[i] + precon[i] / 2;
+		for (size_t i = N; i < length; i += N) for (int c = 0; c < N; c++) recon[i + c] = scanline[i + c] + ((recon[i + c - N] + precon[i + c]) >> 1);
+		break;
+	case 4:
+		for (size_t i = 0; i < N; i++) recon[i] = scanline[i] + precon[i]; //paethPredictor(0, b, 0) is b
+		for (size_t i = N; i < length; i += N) for (int c = 0; c < N; c++) recon[i + c] = scanline[i + c] + paethPredictor(recon[i + c - N], precon[i + c], precon[i + c - N]);
+		break;
+	default: return 36; //error: unexisting filter type given
+	}
+	return 0;
+}
+
+struct PNG //nested functions for PNG decoding
+{
+	struct Info
+	{
+		unsigned long width, height, colorType, bitDepth, compressionMethod, filterMethod, interlaceMethod, key_r, key_g, key_b;
+		bool key_defined; //is a transparent color key given?
+		std::vector<unsigned char> palette;
+	} info;
+	int error;
+	std::vector<unsigned char> zeros; //previous line of the first one
+	void decode(std::vector<unsigned char>& out, const unsigned char* in, size_t size, bool convert_to_rgba32)
 	{
-		struct Info
+		std::vector<unsigned char> scanlines;
+		readAndInflate(scanlines, in, size); if (error) return;
+		unfilterImage(out, scanlines); if (error) return;
+		if (convert_to_rgba32 && (info.colorType != 6 || info.bitDepth != 8)) //conversion needed
 		{
-			unsigned long width, height, colorType, bitDepth, compressionMethod, filterMethod, interlaceMethod, key_r, key_g, key_b;
-			bool key_defined; //is a transparent color key given?
-			std::vector<unsigned char> palette;
-		} info;
-		int error;
-		void decode(std::vector<unsigned char>& out, const unsigned char* in, size_t size, bool convert_to_rgba32)
+			std::vector<unsigned char> data = out;
+			error = convert(out, &data[0], info, info.width, info.height);
+		}
+	}
+	void decodeRGB(unsigned char* out, bool flip_y, const unsigned char* in, size_t size)
+	{ //8 bit RGB rows, the alpha is dropped
+		std::vector<unsigned char> scanlines;
+		readAndInflate(scanlines, in, size); if (error) return;
+		const size_t w = info.width, h = info.height, rowsize = w * 3;
+		if (info.interlaceMethod != 0 || info.bitDepth != 8) //uncommon formats go through the whole 32 bit image
 		{
-			error = 0;
-			if (size == 0 || in == 0) { error = 48; return; } //the given data is empty
-			readPngHeader(&in[0], size); if (error) return;
-			size_t pos = 33; //first byte of the first chunk after the header
-			std::vector<unsigned char> idat; //the data from idat chunks
-			bool IEND = false, known_type = true;
-			info.key_defined = false;
-			while (!IEND) //loop through the chunks, ignoring unknown chunks and stopping at IEND chunk. IDAT data is put at the start of the in buffer
+			std::vector<unsigned char> raw, rgba;
+			unfilterImage(raw, scanlines); if (error) return;
+			error = convert(rgba, raw.empty() ? 0 : &raw[0], info, info.width, info.height); if (error) return;
+			for (size_t y = 0; y < h; y++)
 			{
-				if (pos + 8 >= size) { error = 30; return; } //error: size of the in buffer too small to contain next chunk
-				size_t chunkLength = read32bitInt(&in[pos]); pos += 4;
-				if (chunkLength > 2147483647) { error = 63; return; }
-				if (pos + chunkLength >= size) { error = 35; return; } //error: size of the in buffer too small to contain next chunk
-				if (in[pos + 0] == 'I' && in[pos + 1] == 'D' && in[pos + 2] == 'A' && in[pos + 3] == 'T') //IDAT chunk, containing compressed image data
-				{
-					idat.insert(idat.end(), &in[pos + 4], &in[pos + 4 + chunkLength]);
-					pos += (4 + chunkLength);
-				}
-				else if (in[pos + 0] == 'I' && in[pos + 1] == 'E' && in[pos + 2] == 'N' && in[pos + 3] == 'D') { pos += 4; IEND = true; }
-				else if (in[pos + 0] == 'P' && in[pos + 1] == 'L' && in[pos + 2] == 'T' && in[pos + 3] == 'E') //palette chunk (PLTE)
-				{
-					pos += 4; //go after the 4 letters
-					info.palette.resize(4 * (chunkLength / 3));
-					if (info.palette.size() > (4 * 256)) { error = 38; return; } //error: palette too big
-					for (size_t i = 0; i < info.palette.size(); i += 4)
-					{
-						for (size_t j = 0; j < 3; j++) info.palette[i + j] = in[pos++]; //RGB
-						info.palette[i + 3] = 255; //alpha
-					}
-				}
-				else if (in[pos + 0] == 't' && in[pos + 1] == 'R' && in[pos + 2] == 'N' && in[pos + 3] == 'S') //palette transparency chunk (tRNS)
-				{
-					pos += 4; //go after the 4 letters
-					if (info.colorType == 3)
-					{
-						if (4 * chunkLength > info.palette.size()) { error = 39; return; } //error: more alpha values given than there are palette entries
-						for (size_t i = 0; i < chunkLength; i++) info.palette[4 * i + 3] = in[pos++];
-					}
-					else if (info.colorType == 0)
-					{
-						if (chunkLength != 2) { error = 40; return; } //error: this chunk must be 2 bytes for greyscale image
-						info.key_defined = 1; info.key_r = info.key_g = info.key_b = 256 * in[pos] + in[pos + 1]; pos += 2;
-					}
-					else if (info.colorType == 2)
-					{
-						if (chunkLength != 6) { error = 41; return; } //error: this chunk must be 6 bytes for RGB image
-						info.key_defined = 1;
-						info.key_r = 256 * in[pos] + in[pos + 1]; pos += 2;
-						info.key_g = 256 * in[pos] + in[pos + 1]; pos += 2;
-						info.key_b = 256 * in[pos] + in[pos + 1]; pos += 2;
-					}
-					else { error = 42; return; } //error: tRNS chunk not allowed for other color models
-				}
-				else //it's not an implemented chunk type, so ignore it: skip over the data
-				{
-					if (!(in[pos + 0] & 32)) { error = 69; return; } //error: unknown critical chunk (5th bit of first byte of chunk type is 0)
-					pos += (chunkLength + 4); //skip 4 letters and uninterpreted data of unimplemented chunk
-					known_type = false;
-				}
-				pos += 4; //step over CRC (which is ignored)
+				unsigned char* dst = out + (flip_y ? h - 1 - y : y) * rowsize; const unsigned char* src = &rgba[y * w * 4];
+				for (size_t x = 0; x < w; x++) { dst[3 * x + 0] = src[4 * x + 0]; dst[3 * x + 1] = src[4 * x + 1]; dst[3 * x + 2] = src[4 * x + 2]; }
 			}
-			unsigned long bpp = getBpp(info);
-			std::vector<unsigned char> scanlines(((info.width * (info.height * bpp + 7)) / 8) + info.height); //now the out buffer will be filled
-			Zlib zlib; //decompress with the Zlib decompressor
-			error = zlib.decompress(scanlines, idat); if (error) return; //stop if the zlib decompressor returned an error
-			size_t bytewidth = (bpp + 7) / 8, outlength = (info.height * info.width * bpp + 7) / 8;
-			out.resize(outlength); //time to fill the out buffer
-			unsigned char* out_ = outlength ? &out[0] : 0; //use a regular pointer to the std::vector for faster code if compiled without optimization
-			if (info.interlaceMethod == 0) //no interlace, just filter
+			return;
+		}
+		//one row at a time: unfilter it and store it in the place it goes, only two lines are kept
+		const size_t bytewidth = getBpp(info) / 8, linelength = w * bytewidth;
+		std::vector<unsigned char> lines(2 * linelength + 1);
+		unsigned char* linen = &lines[0]; unsigned char* lineo = &lines[linelength];
+		zeros.assign(linelength + 1, 0);
+		const unsigned char* prevline = &zeros[0];
+		for (size_t y = 0; y < info.height; y++)
+		{
+			const unsigned char* scanline = &scanlines[y * (linelength + 1)];
+			unFilterScanline(linen, scanline + 1, prevline, bytewidth, scanline[0], linelength); if (error) return;
+			unsigned char* dst = out + (flip_y ? h - 1 - y : y) * rowsize;
+			switch (info.colorType)
 			{
-				size_t linestart = 0, linelength = (info.width * bpp + 7) / 8; //length in bytes of a scanline, excluding the filtertype byte
-				if (bpp >= 8) //byte per byte
-					for (unsigned long y = 0; y < info.height; y++)
-					{
-						unsigned long filterType = scanlines[linestart];
-						const unsigned char* prevline = (y == 0) ? 0 : &out_[(y - 1) * info.width * bytewidth];
-						unFilterScanline(&out_[linestart - y], &scanlines[linestart + 1], prevline, bytewidth, filterType, linelength); if (error) return;
-						linestart += (1 + linelength); //go to start of next scanline
-					}
-				else //less than 8 bits per pixel, so fill it up bit per bit
+			case 2: memcpy(dst, linen, rowsize); break; //RGB
+			case 6: for (size_t x = 0; x < w; x++) { dst[3 * x + 0] = linen[4 * x + 0]; dst[3 * x + 1] = linen[4 * x + 1]; dst[3 * x + 2] = linen[4 * x + 2]; } break; //RGB with alpha
+			case 0: for (size_t x = 0; x < w; x++) dst[3 * x + 0] = dst[3 * x + 1] = dst[3 * x + 2] = linen[x]; break; //greyscale
+			case 4: for (size_t x = 0; x < w; x++) dst[3 * x + 0] = dst[3 * x + 1] = dst[3 * x + 2] = linen[2 * x]; break; //greyscale with alpha
+			case 3: //indexed color (palette)
+				for (size_t x = 0; x < w; x++)
 				{
-					std::vector<unsigned char> templine((info.width * bpp + 7) >> 3); //only used if bpp < 8
-					for (size_t y = 0, obp = 0; y < info.height; y++)
-					{
-						unsigned long filterType = scanlines[linestart];
-						const unsigned char* prevline = (y == 0) ? 0 : &out_[(y - 1) * info.width * bytewidth];
-						unFilterScanline(&templine[0], &scanlines[linestart + 1], prevline, bytewidth, filterType, linelength); if (error) return;
-						for (size_t bp = 0; bp < info.width * bpp;) setBitOfReversedStream(obp, out_, readBitFromReversedStream(bp, &templine[0]));
-						linestart += (1 + linelength); //go to start of next scanline
-					}
+					if (4U * linen[x] >= info.palette.size()) { error = 46; return; }
+					const unsigned char* color = &info.palette[4 * linen[x]];
+					dst[3 * x + 0] = color[0]; dst[3 * x + 1] = color[1]; dst[3 * x + 2] = color[2];
 				}
+				break;
 			}
-			else //interlaceMethod is 1 (Adam7)
-			{
-				size_t passw[7] = { (info.width + 7) / 8, (info.width + 3) / 8, (info.width + 3) / 4, (info.width + 1) / 4, (info.width + 1) / 2, (info.width + 0) / 2, (info.width + 0) / 1 };
-				size_t passh[7] = { (info.height + 7) / 8, (info.height + 7) / 8, (info.height + 3) / 8, (info.height + 3) / 4, (info.height + 1) / 4, (info.height + 1) / 2, (info.height + 0) / 2 };
-				size_t passstart[7] = { 0 };
-				size_t pattern[28] = { 0,4,0,2,0,1,0,0,0,4,0,2,0,1,8,8,4,4,2,2,1,8,8,8,4,4,2,2 }; //values for the adam7 passes
-				for (int i = 0; i < 6; i++) passstart[i + 1] = passstart[i] + passh[i] * ((passw[i] ? 1 : 0) + (passw[i] * bpp + 7) / 8);
-				std::vector<unsigned char> scanlineo((info.width * bpp + 7) / 8), scanlinen((info.width * bpp + 7) / 8); //"old" and "new" scanline
-				for (int i = 0; i < 7; i++)
-					adam7Pass(&out_[0], &scanlinen[0], &scanlineo[0], &scanlines[passstart[i]], info.width, pattern[i], pattern[i + 7], pattern[i + 14], pattern[i + 21], passw[i], passh[i], bpp);
-			}
-			if (convert_to_rgba32 && (info.colorType != 6 || info.bitDepth != 8)) //conversion needed
-			{
-				std::vector<unsigned char> data = out;
-				error = convert(out, &data[0], info, info.width, info.height);
-			}
-		}
-		void readPngHeader(const unsigned char* in, size_t inlength) //read the information from the header and store it in the Info
-		{
-			if (inlength < 29) { error = 27; return; } //error: the data length is smaller than the length of the header
-			if (in[0] != 137 || in[1] != 80 || in[2] != 78 || in[3] != 71 || in[4] != 13 || in[5] != 10 || in[6] != 26 || in[7] != 10) { error = 28; return; } //no PNG signature
-			if (in[12] != 'I' || in[13] != 'H' || in[14] != 'D' || in[15] != 'R') { error = 29; return; } //error: it doesn't start with a IHDR chunk!
-			info.width = read32bitInt(&in[16]); info.height = read32bitInt(&in[20]);
-			info.bitDepth = in[24]; info.colorType = in[25];
-			info.compressionMethod = in[26]; if (in[26] != 0) { error = 32; return; } //error: only compression method 0 is allowed in the specification
-			info.filterMethod = in[27]; if (in[27] != 0) { error = 33; return; } //error: only filter method 0 is allowed in the specification
-			info.interlaceMethod = in[28]; if (in[28] > 1) { error = 34; return; } //error: only interlace methods 0 and 1 exist in the specification
-			error = checkColorValidity(info.colorType, info.bitDepth);
+			prevline = linen;
+			unsigned char* temp = linen; linen = lineo; lineo = temp; //swap the two buffer pointers "line old" and "line new"
 		}
-		void unFilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t bytewidth, unsigned long filterType, size_t length)
+	}
+	void readAndInflate(std::vector<unsigned char>& scanlines, const unsigned char* in, size_t size)
+	{ //reads the chunks and decompresses the IDAT data into scanlines
+		error = 0;
+		if (size == 0 || in == 0) { error = 48; return; } //the given data is empty
+		readPngHeader(&in[0], size); if (error) return;
+		size_t pos = 33; //first byte of the first chunk after the header
+		std::vector<unsigned char> idat; //the data from idat chunks
+		bool IEND = false;
+		info.key_defined = false;
+		while (!IEND) //loop through the chunks, ignoring unknown chunks and stopping at IEND chunk. IDAT data is put at the start of the in buffer
 		{
-			switch (filterType)
+			if (pos + 8 >= size) { error = 30; return; } //error: size of the in buffer too small to contain next chunk
+			size_t chunkLength = read32bitInt(&in[pos]); pos += 4;
+			if (chunkLength > 2147483647) { error = 63; return; }
+			if (pos + chunkLength >= size) { error = 35; return; } //error: size of the in buffer too small to contain next chunk
+			if (in[pos + 0] == 'I' && in[pos + 1] == 'D' && in[pos + 2] == 'A' && in[pos + 3] == 'T') //IDAT chunk, containing compressed image data
 			{
-			case 0: for (size_t i = 0; i < length; i++) recon[i] = scanline[i]; break;
-			case 1:
-				for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i];
-				for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + recon[i - bytewidth];
-				break;
-			case 2:
-				if (precon) for (size_t i = 0; i < length; i++) recon[i] = scanline[i] + precon[i];
-				else       for (size_t i = 0; i < length; i++) recon[i] = scanline[i];
-				break;
-			case 3:
-				if (precon)
+				idat.insert(idat.end(), &in[pos + 4], &in[pos + 4 + chunkLength]);
+				pos += (4 + chunkLength);
+			}
+			else if (in[pos + 0] == 'I' && in[pos + 1] == 'E' && in[pos + 2] == 'N' && in[pos + 3] == 'D') { pos += 4; IEND = true; }
+			else if (in[pos + 0] == 'P' && in[pos + 1] == 'L' && in[pos + 2] == 'T' && in[pos + 3] == 'E') //palette chunk (PLTE)
+			{
+				pos += 4; //go after the 4 letters
+				info.palette.resize(4 * (chunkLength / 3));
+				if (info.palette.size() > (4 * 256)) { error = 38; return; } //error: palette too big
+				for (size_t i = 0; i < info.palette.size(); i += 4)
 				{
-					for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i] + precon[i] / 2;
-					for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) / 2);
+					for (size_t j = 0; j < 3; j++) info.palette[i + j] = in[pos++]; //RGB
+					info.palette[i + 3] = 255; //alpha
 				}
-				else
+			}
+			else if (in[pos + 0] == 't' && in[pos + 1] == 'R' && in[pos + 2] == 'N' && in[pos + 3] == 'S') //palette transparency chunk (tRNS)
+			{
+				pos += 4; //go after the 4 letters
+				if (info.colorType == 3)
 				{
-					for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i];
-					for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + recon[i - bytewidth] / 2;
+					if (4 * chunkLength > info.palette.size()) { error = 39; return; } //error: more alpha values given than there are palette entries
+					for (size_t i = 0; i < chunkLength; i++) info.palette[4 * i + 3] = in[pos++];
 				}
-				break;
-			case 4:
-				if (precon)
+				else if (info.colorType == 0)
 				{
-					for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i] + paethPredictor(0, precon[i], 0);
-					for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + paethPredictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]);
+					if (chunkLength != 2) { error = 40; return; } //error: this chunk must be 2 bytes for greyscale image
+					info.key_defined = 1; info.key_r = info.key_g = info.key_b = 256 * in[pos] + in[pos + 1]; pos += 2;
 				}
-				else
+				else if (info.colorType == 2)
 				{
-					for (size_t i = 0; i < bytewidth; i++) recon[i] = scanline[i];
-					for (size_t i = bytewidth; i < length; i++) recon[i] = scanline[i] + paethPredictor(recon[i - bytewidth], 0, 0);
+					if (chunkLength != 6) { error = 41; return; } //error: this chunk must be 6 bytes for RGB image
+					info.key_defined = 1;
+					info.key_r = 256 * in[pos] + in[pos + 1]; pos += 2;
+					info.key_g = 256 * in[pos] + in[pos + 1]; pos += 2;
+					info.key_b = 256 * in[pos] + in[pos + 1]; pos += 2;
 				}
-				break;
-			default: error = 36; return; //error: unexisting filter type given
+				else { error = 42; return; } //error: tRNS chunk not allowed for other color models
 			}
-		}
-		void adam7Pass(unsigned char* out, unsigned char* linen, unsigned char* lineo, const unsigned char* in, unsigned long w, size_t passleft, size_t passtop, size_t spacex, size_t spacey, size_t passw, size_t passh, unsigned long bpp)
-		{ //filter and reposition the pixels into the output when the image is Adam7 interlaced. This function can only do it after the full image is already decoded. The out buffer must have the correct allocated memory size already.
-			if (passw == 0) return;
-			size_t bytewidth = (bpp + 7) / 8, linelength = 1 + ((bpp * passw + 7) / 8);
-			for (unsigned long y = 0; y < passh; y++)
+			else //it's not an implemented chunk type, so ignore it: skip over the data
 			{
-				unsigned char filterType = in[y * linelength], *prevline = (y == 0) ? 0 : lineo;
-				unFilterScanline(linen, &in[y * linelength + 1], prevline, bytewidth, filterType, (w * bpp + 7) / 8); if (error) return;
-				if (bpp >= 8) for (size_t i = 0; i < passw; i++) for (size_t b = 0; b < bytewidth; b++) //b = current byte of this pixel
-					out[bytewidth * w * (passtop + spacey * y) + bytewidth * (passleft + spacex * i) + b] = linen[bytewidth * i + b];
-				else for (size_t i = 0; i < passw; i++)
-				{
-					size_t obp = bpp * w * (passtop + spacey * y) + bpp * (passleft + spacex * i), bp = i * bpp;
-					for (size_t b = 0; b < bpp; b++) setBitOfReversedStream(obp, out, readBitFromReversedStream(bp, &linen[0]));
-				}
-				unsigned char* temp = linen; linen = lineo; lineo = temp; //swap the two buffer pointers "line old" and "line new"
+				if (!(in[pos + 0] & 32)) { error = 69; return; } //error: unknown critical chunk (5th bit of first byte of chunk type is 0)
+				pos += (chunkLength + 4); //skip 4 letters and uninterpreted data of unimplemented chunk
 			}
+			pos += 4; //step over CRC (which is ignored)
 		}
-		static unsigned long readBitFromReversedStream(size_t& bitp, const unsigned char* bits) { unsigned long result = (bits[bitp >> 3] >> (7 - (bitp & 0x7))) & 1; bitp++; return result; }
-		static unsigned long readBitsFromReversedStream(size_t& bitp, const unsigned char* bits, unsigned long nbits)
+		unsigned long bpp = getBpp(info);
+		scanlines.resize(((info.width * (info.height * bpp + 7)) / 8) + info.height); //now the out buffer will be filled
+		Zlib zlib; //decompress with the Zlib decompressor
+		error = zlib.decompress(scanlines, idat); if (error) return; //stop if the zlib decompressor returned an error
+		size_t needed = info.height * (1 + (info.width * bpp + 7) / 8);
+		if (info.interlaceMethod == 1) //the 7 passes of Adam7, every one is a small image with its own scanlines
 		{
-			unsigned long result = 0;
-			for (size_t i = nbits - 1; i < nbits; i--) result += ((readBitFromReversedStream(bitp, bits)) << i);
-			return result;
+			size_t passw[7], passh[7]; adam7Sizes(passw, passh);
+			needed = 0;
+			for (int i = 0; i < 7; i++) needed += passh[i] * ((passw[i] ? 1 : 0) + (passw[i] * bpp + 7) / 8);
 		}
-		void setBitOfReversedStream(size_t& bitp, unsigned char* bits, unsigned long bit) { bits[bitp >> 3] |= (bit << (7 - (bitp & 0x7))); bitp++; }
-		unsigned long read32bitInt(const unsigned char* buffer) { return (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3]; }
-		int checkColorValidity(unsigned long colorType, unsigned long bd) //return type is a LodePNG error code
+		if (scanlines.size() < needed) { error = 71; return; } //error: less data than the image needs
+	}
+	void unfilterImage(std::vector<unsigned char>& out, std::vector<unsigned char>& scanlines)
+	{ //unfilters the scanlines into out, with the bits of every pixel as they are in the file
+		unsigned long bpp = getBpp(info);
+		size_t bytewidth = (bpp + 7) / 8, outlength = (info.height * info.width * bpp + 7) / 8;
+		out.resize(outlength); //time to fill the out buffer
+		unsigned char* out_ = outlength ? &out[0] : 0; //use a regular pointer to the std::vector for faster code if compiled without optimization
+		zeros.assign((info.width * bpp + 7) / 8 + 1, 0);
+		if (info.interlaceMethod == 0) //no interlace, just filter
 		{
-			if ((colorType == 2 || colorType == 4 || colorType == 6)) { if (!(bd == 8 || bd == 16)) return 37; else return 0; }
-			else if (colorType == 0) { if (!(bd == 1 || bd == 2 || bd == 4 || bd == 8 || bd == 16)) return 37; else return 0; }
-			else if (colorType == 3) { if (!(bd == 1 || bd == 2 || bd == 4 || bd == 8)) return 37; else return 0; }
-			else return 31; //unexisting color type
-		}
-		unsigned long getBpp(const Info& info)
-		{
-			if (info.colorType == 2) return (3 * info.bitDepth);
-			else if (info.colorType >= 4) return (info.colorType - 2) * info.bitDepth;
-			else return info.bitDepth;
-		}
-		int convert(std::vector<unsigned char>& out, const unsigned char* in, Info& infoIn, unsigned long w, unsigned long h)
-		{ //converts from any color type to 32-bit. return value = LodePNG error code
-			size_t numpixels = w * h, bp = 0;
-			out.resize(numpixels * 4);
-			unsigned char* out_ = out.empty() ? 0 : &out[0]; //faster if compiled without optimization
-			if (infoIn.bitDepth == 8 && infoIn.colorType == 0) //greyscale
-				for (size_t i = 0; i < numpixels; i++)
-				{
-					out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[i];
-					out_[4 * i + 3] = (infoIn.key_defined && in[i] == infoIn.key_r) ? 0 : 255;
-				}
-			else if (infoIn.bitDepth == 8 && infoIn.colorType == 2) //RGB color
-				for (size_t i = 0; i < numpixels; i++)
-				{
-					for (size_t c = 0; c < 3; c++) out_[4 * i + c] = in[3 * i + c];
-					out_[4 * i + 3] = (infoIn.key_defined == 1 && in[3 * i + 0] == infoIn.key_r && in[3 * i + 1] == infoIn.key_g && in[3 * i + 2] == infoIn.key_b) ? 0 : 255;
-				}
-			else if (infoIn.bitDepth == 8 && infoIn.colorType == 3) //indexed color (palette)
-				for (size_t i = 0; i < numpixels; i++)
-				{
-					if (4U * in[i] >= infoIn.palette.size()) return 46;
-					for (size_t c = 0; c < 4; c++) out_[4 * i + c] = infoIn.palette[4 * in[i] + c]; //get rgb colors from the palette
-				}
-			else if (infoIn.bitDepth == 8 && infoIn.colorType == 4) //greyscale with alpha
-				for (size_t i = 0; i < numpixels; i++)
-				{
-					out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[2 * i + 0];
-					out_[4 * i + 3] = in[2 * i + 1];
-				}
-			else if (infoIn.bitDepth == 8 && infoIn.colorType == 6) for (size_t i = 0; i < numpixels; i++) for (size_t c = 0; c < 4; c++) out_[4 * i + c] = in[4 * i + c]; //RGB with alpha
-			else if (infoIn.bitDepth == 16 && infoIn.colorType == 0) //greyscale
-				for (size_t i = 0; i < numpixels; i++)
+			size_t linestart = 0, linelength = (info.width * bpp + 7) / 8; //length in bytes of a scanline, excluding the filtertype byte
+			if (bpp >= 8) //byte per byte
+				for (unsigned long y = 0; y < info.height; y++)
 				{
-					out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[2 * i];
-					out_[4 * i + 3] = (infoIn.key_defined && 256U * in[i] + in[i + 1] == infoIn.key_r) ? 0 : 255;
+					unsigned long filterType = scanlines[linestart];
+					const unsigned char* prevline = (y == 0) ? &zeros[0] : &out_[(y - 1) * info.width * bytewidth];
+					unFilterScanline(&out_[linestart - y], &scanlines[linestart + 1], prevline, bytewidth, filterType, linelength); if (error) return;
+					linestart += (1 + linelength); //go to start of next scanline
 				}
-			else if (infoIn.bitDepth == 16 && infoIn.colorType == 2) //RGB color
-				for (size_t i = 0; i < numpixels; i++)
-				{
-					for (size_t c = 0; c < 3; c++) out_[4 * i + c] = in[6 * i + 2 * c];
-					out_[4 * i + 3] = (infoIn.key_defined && 256U * in[6 * i + 0] + in[6 * i + 1] == infoIn.key_r && 256U * in[6 * i + 2] + in[6 * i + 3] == infoIn.key_g && 256U * in[6 * i + 4] + in[6 * i + 5] == infoIn.key_b) ? 0 : 255;
-				}
-			else if (infoIn.bitDepth == 16 && infoIn.colorType == 4) //greyscale with alpha
-				for (size_t i = 0; i < numpixels; i++)
-				{
-					out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[4 * i]; //most significant byte
-					out_[4 * i + 3] = in[4 * i + 2];
-				}
-			else if (infoIn.bitDepth == 16 && infoIn.colorType == 6) for (size_t i = 0; i < numpixels; i++) for (size_t c = 0; c < 4; c++) out_[4 * i + c] = in[8 * i + 2 * c]; //RGB with alpha
-			else if (infoIn.bitDepth < 8 && infoIn.colorType == 0) //greyscale
-				for (size_t i = 0; i < numpixels; i++)
-				{
-					unsigned long value = (readBitsFromReversedStream(bp, in, infoIn.bitDepth) * 255) / ((1 << infoIn.bitDepth) - 1); //scale value from 0 to 255
-					out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = (unsigned char)(value);
-					out_[4 * i + 3] = (infoIn.key_defined && value && ((1U << infoIn.bitDepth) - 1U) == infoIn.key_r && ((1U << infoIn.bitDepth) - 1U)) ? 0 : 255;
-				}
-			else if (infoIn.bitDepth < 8 && infoIn.colorType == 3) //palette
-				for (size_t i = 0; i < numpixels; i++)
+			else //less than 8 bits per pixel, so fill it up bit per bit
+			{
+				std::vector<unsigned char> templine((info.width * bpp + 7) >> 3), prevline((info.width * bpp + 7) >> 3, 0); //only used if bpp < 8
+				for (size_t y = 0, obp = 0; y < info.height; y++)
 				{
-					unsigned long value = readBitsFromReversedStream(bp, in, infoIn.bitDepth);
-					if (4 * value >= infoIn.palette.size()) return 47;
-					for (size_t c = 0; c < 4; c++) out_[4 * i + c] = infoIn.palette[4 * value + c]; //get rgb colors from the palette
+					unsigned long filterType = scanlines[linestart];
+					unFilterScanline(&templine[0], &scanlines[linestart + 1], &prevline[0], bytewidth, filterType, linelength); if (error) return;
+					for (size_t bp = 0; bp < info.width * bpp;) setBitOfReversedStream(obp, out_, readBitFromReversedStream(bp, &templine[0]));
+					prevline.swap(templine);
+					linestart += (1 + linelength); //go to start of next scanline
 				}
-			return 0;
+			}
 		}
-		unsigned char paethPredictor(short a, short b, short c) //Paeth predicter, used by PNG filter type 4
+		else //interlaceMethod is 1 (Adam7)
 		{
-			short p = a + b - c, pa = p > a ? (p - a) : (a - p), pb = p > b ? (p - b) : (b - p), pc = p > c ? (p - c) : (c - p);
-			return (unsigned char)((pa <= pb && pa <= pc) ? a : pb <= pc ? b : c);
+			size_t passw[7], passh[7]; adam7Sizes(passw, passh);
+			size_t passstart[7] = { 0 };
+			size_t pattern[28] = { 0,4,0,2,0,1,0,0,0,4,0,2,0,1,8,8,4,4,2,2,1,8,8,8,4,4,2,2 }; //values for the adam7 passes
+			for (int i = 0; i < 6; i++) passstart[i + 1] = passstart[i] + passh[i] * ((passw[i] ? 1 : 0) + (passw[i] * bpp + 7) / 8);
+			std::vector<unsigned char> scanlineo((info.width * bpp + 7) / 8), scanlinen((info.width * bpp + 7) / 8); //"old" and "new" scanline
+			for (int i = 0; i < 7; i++)
+				adam7Pass(&out_[0], &scanlinen[0], &scanlineo[0], &scanlines[passstart[i]], info.width, pattern[i], pattern[i + 7], pattern[i + 14], pattern[i + 21], passw[i], passh[i], bpp);
 		}
-	};
+	}
+	void readPngHeader(const unsigned char* in, size_t inlength) //read the information from the header and store it in the Info
+	{
+		error = 0;
+		if (inlength < 29) { error = 27; return; } //error: the data length is smaller than the length of the header
+		if (in[0] != 137 || in[1] != 80 || in[2] != 78 || in[3] != 71 || in[4] != 13 || in[5] != 10 || in[6] != 26 || in[7] != 10) { error = 28; return; } //no PNG signature
+		if (in[12] != 'I' || in[13] != 'H' || in[14] != 'D' || in[15] != 'R') { error = 29; return; } //error: it doesn't start with a IHDR chunk!
+		info.width = read32bitInt(&in[16]); info.height = read32bitInt(&in[20]);
+		info.bitDepth = in[24]; info.colorType = in[25];
+		info.compressionMethod = in[26]; if (in[26] != 0) { error = 32; return; } //error: only compression method 0 is allowed in the specification
+		info.filterMethod = in[27]; if (in[27] != 0) { error = 33; return; } //error: only filter method 0 is allowed in the specification
+		info.interlaceMethod = in[28]; if (in[28] > 1) { error = 34; return; } //error: only interlace methods 0 and 1 exist in the specification
+		error = checkColorValidity(info.colorType, info.bitDepth);
+	}
+	void unFilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon, size_t bytewidth, unsigned long filterType, size_t length)
+	{ //precon is never null, the first line uses a line of zeros
+		switch (bytewidth)
+		{
+		case 1: error = unfilterPixels<1>(recon, scanline, precon, filterType, length); break;
+		case 2: error = unfilterPixels<2>(recon, scanline, precon, filterType, length); break;
+		case 3: error = unfilterPixels<3>(recon, scanline, precon, filterType, length); break;
+		case 4: error = unfilterPixels<4>(recon, scanline, precon, filterType, length); break;
+		case 6: error = unfilterPixels<6>(recon, scanline, precon, filterType, length); break;
+		case 8: error = unfilterPixels<8>(recon, scanline, precon, filterType, length); break;
+		default: error = 31; break; //there are no other pixel sizes
+		}
+	}
+	void adam7Sizes(size_t passw[7], size_t passh[7])
+	{
+		const size_t w = info.width, h = info.height;
+		passw[0] = (w + 7) / 8; passw[1] = (w + 3) / 8; passw[2] = (w + 3) / 4; passw[3] = (w + 1) / 4; passw[4] = (w + 1) / 2; passw[5] = (w + 0) / 2; passw[6] = (w + 0) / 1;
+		passh[0] = (h + 7) / 8; passh[1] = (h + 7) / 8; passh[2] = (h + 3) / 8; passh[3] = (h + 3) / 4; passh[4] = (h + 1) / 4; passh[5] = (h + 1) / 2; passh[6] = (h + 0) / 2;
+	}
+	void adam7Pass(unsigned char* out, unsigned char* linen, unsigned char* lineo, const unsigned char* in, unsigned long w, size_t passleft, size_t passtop, size_t spacex, size_t spacey, size_t passw, size_t passh, unsigned long bpp)
+	{ //filter and reposition the pixels into the output when the image is Adam7 interlaced. This function can only do it after the full image is already decoded. The out buffer must have the correct allocated memory size already.
+		if (passw == 0) return;
+		size_t bytewidth = (bpp + 7) / 8, linelength = 1 + ((bpp * passw + 7) / 8);
+		for (unsigned long y = 0; y < passh; y++)
+		{
+			unsigned char filterType = in[y * linelength]; const unsigned char* prevline = (y == 0) ? &zeros[0] : lineo;
+			unFilterScanline(linen, &in[y * linelength + 1], prevline, bytewidth, filterType, linelength - 1); if (error) return;
+			if (bpp >= 8) for (size_t i = 0; i < passw; i++) for (size_t b = 0; b < bytewidth; b++) //b = current byte of this pixel
+				out[bytewidth * w * (passtop + spacey * y) + bytewidth * (passleft + spacex * i) + b] = linen[bytewidth * i + b];
+			else for (size_t i = 0; i < passw; i++)
+			{
+				size_t obp = bpp * w * (passtop + spacey * y) + bpp * (passleft + spacex * i), bp = i * bpp;
+				for (size_t b = 0; b < bpp; b++) setBitOfReversedStream(obp, out, readBitFromReversedStream(bp, &linen[0]));
+			}
+			unsigned char* temp = linen; linen = lineo; lineo = temp; //swap the two buffer pointers "line old" and "line new"
+		}
+	}
+	static unsigned long readBitFromReversedStream(size_t& bitp, const unsigned char* bits) { unsigned long result = (bits[bitp >> 3] >> (7 - (bitp & 0x7))) & 1; bitp++; return result; }
+	static unsigned long readBitsFromReversedStream(size_t& bitp, const unsigned char* bits, unsigned long nbits)
+	{
+		unsigned long result = 0;
+		for (size_t i = nbits - 1; i < nbits; i--) result += ((readBitFromReversedStream(bitp, bits)) << i);
+		return result;
+	}
+	void setBitOfReversedStream(size_t& bitp, unsigned char* bits, unsigned long bit) { bits[bitp >> 3] |= (bit << (7 - (bitp & 0x7))); bitp++; }
+	unsigned long read32bitInt(const unsigned char* buffer) { return (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3]; }
+	int checkColorValidity(unsigned long colorType, unsigned long bd) //return type is a LodePNG error code
+	{
+		if ((colorType == 2 || colorType == 4 || colorType == 6)) { if (!(bd == 8 || bd == 16)) return 37; else return 0; }
+		else if (colorType == 0) { if (!(bd == 1 || bd == 2 || bd == 4 || bd == 8 || bd == 16)) return 37; else return 0; }
+		else if (colorType == 3) { if (!(bd == 1 || bd == 2 || bd == 4 || bd == 8)) return 37; else return 0; }
+		else return 31; //unexisting color type
+	}
+	unsigned long getBpp(const Info& info)
+	{
+		if (info.colorType == 2) return (3 * info.bitDepth);
+		else if (info.colorType >= 4) return (info.colorType - 2) * info.bitDepth;
+		else return info.bitDepth;
+	}
+	int convert(std::vector<unsigned char>& out, const unsigned char* in, Info& infoIn, unsigned long w, unsigned long h)
+	{ //converts from any color type to 32-bit. return value = LodePNG error code
+		size_t numpixels = w * h, bp = 0;
+		out.resize(numpixels * 4);
+		unsigned char* out_ = out.empty() ? 0 : &out[0]; //faster if compiled without optimization
+		if (infoIn.bitDepth == 8 && infoIn.colorType == 0) //greyscale
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[i];
+				out_[4 * i + 3] = (infoIn.key_defined && in[i] == infoIn.key_r) ? 0 : 255;
+			}
+		else if (infoIn.bitDepth == 8 && infoIn.colorType == 2) //RGB color
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				for (size_t c = 0; c < 3; c++) out_[4 * i + c] = in[3 * i + c];
+				out_[4 * i + 3] = (infoIn.key_defined == 1 && in[3 * i + 0] == infoIn.key_r && in[3 * i + 1] == infoIn.key_g && in[3 * i + 2] == infoIn.key_b) ? 0 : 255;
+			}
+		else if (infoIn.bitDepth == 8 && infoIn.colorType == 3) //indexed color (palette)
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				if (4U * in[i] >= infoIn.palette.size()) return 46;
+				for (size_t c = 0; c < 4; c++) out_[4 * i + c] = infoIn.palette[4 * in[i] + c]; //get rgb colors from the palette
+			}
+		else if (infoIn.bitDepth == 8 && infoIn.colorType == 4) //greyscale with alpha
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[2 * i + 0];
+				out_[4 * i + 3] = in[2 * i + 1];
+			}
+		else if (infoIn.bitDepth == 8 && infoIn.colorType == 6) for (size_t i = 0; i < numpixels; i++) for (size_t c = 0; c < 4; c++) out_[4 * i + c] = in[4 * i + c]; //RGB with alpha
+		else if (infoIn.bitDepth == 16 && infoIn.colorType == 0) //greyscale
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[2 * i];
+				out_[4 * i + 3] = (infoIn.key_defined && 256U * in[i] + in[i + 1] == infoIn.key_r) ? 0 : 255;
+			}
+		else if (infoIn.bitDepth == 16 && infoIn.colorType == 2) //RGB color
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				for (size_t c = 0; c < 3; c++) out_[4 * i + c] = in[6 * i + 2 * c];
+				out_[4 * i + 3] = (infoIn.key_defined && 256U * in[6 * i + 0] + in[6 * i + 1] == infoIn.key_r && 256U * in[6 * i + 2] + in[6 * i + 3] == infoIn.key_g && 256U * in[6 * i + 4] + in[6 * i + 5] == infoIn.key_b) ? 0 : 255;
+			}
+		else if (infoIn.bitDepth == 16 && infoIn.colorType == 4) //greyscale with alpha
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = in[4 * i]; //most significant byte
+				out_[4 * i + 3] = in[4 * i + 2];
+			}
+		else if (infoIn.bitDepth == 16 && infoIn.colorType == 6) for (size_t i = 0; i < numpixels; i++) for (size_t c = 0; c < 4; c++) out_[4 * i + c] = in[8 * i + 2 * c]; //RGB with alpha
+		else if (infoIn.bitDepth < 8 && infoIn.colorType == 0) //greyscale
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				unsigned long value = (readBitsFromReversedStream(bp, in, infoIn.bitDepth) * 255) / ((1 << infoIn.bitDepth) - 1); //scale value from 0 to 255
+				out_[4 * i + 0] = out_[4 * i + 1] = out_[4 * i + 2] = (unsigned char)(value);
+				out_[4 * i + 3] = (infoIn.key_defined && value && ((1U << infoIn.bitDepth) - 1U) == infoIn.key_r && ((1U << infoIn.bitDepth) - 1U)) ? 0 : 255;
+			}
+		else if (infoIn.bitDepth < 8 && infoIn.colorType == 3) //palette
+			for (size_t i = 0; i < numpixels; i++)
+			{
+				unsigned long value = readBitsFromReversedStream(bp, in, infoIn.bitDepth);
+				if (4 * value >= infoIn.palette.size()) return 47;
+				for (size_t c = 0; c < 4; c++) out_[4 * i + c] = infoIn.palette[4 * value + c]; //get rgb colors from the palette
+			}
+		return 0;
+	}
+};
 
-	PNG decoder; 
+} // namespace
+
+int decodePNG(std::vector<unsigned char>& out_image, unsigned int& image_width, unsigned int& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32)
+{
+	PNG decoder;
 	decoder.decode(out_image, in_png, in_size, convert_to_rgba32);
 	image_width = decoder.info.width;
 	image_height = decoder.info.height;
 	return decoder.error;
-}
\ No newline at end of file
+}
+
+int decodePNG(unsigned char* out_rgb, unsigned int& image_width, unsigned int& image_height, const unsigned char* in_png, size_t in_size, bool flip_y)
+{
+	PNG decoder;
+	if (!out_rgb) //only the size
+	{
+		if (!in_png) return 48; //the given data is empty
+		decoder.readPngHeader(in_png, in_size);
+	}
+	else
+		decoder.decodeRGB(out_rgb, flip_y, in_png, in_size);
+	image_width = decoder.info.width;
+	image_height = decoder.info.height;
+	return decoder.error;
+}
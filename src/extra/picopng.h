@@ -3,4 +3,7 @@
 #include <vector>
 #include <string.h>
 
-int decodePNG(std::vector<unsigned char>& out_image, unsigned int& image_width, unsigned int& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32 = true);
\ No newline at end of file
+int decodePNG(std::vector<unsigned char>& out_image, unsigned int& image_width, unsigned int& image_height, const unsigned char* in_png, size_t in_size, bool convert_to_rgba32 = true);
+// Decodes the PNG straight into 8 bit RGB rows (the alpha is dropped), bottom row first if flip_y
+// out_rgb needs image_width * image_height * 3 bytes, pass NULL to only read the size
+int decodePNG(unsigned char* out_rgb, unsigned int& image_width, unsigned int& image_height, const unsigned char* in_png, size_t in_size, bool flip_y = false);
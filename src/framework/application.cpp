@@ -2,13 +2,28 @@
 #include "mesh.h"
 #include "shader.h"
 #include "utils.h" 
+#include "camera.h"
+#include "entity.h"
+#include "presenter.h"
+#include "jobsystem.h"
+#include "asset_loader.h"
+#include "arena.h"
 #include <string>
+#include <cfloat>
+#include <memory>
 
 
 
+static double msSince(const std::chrono::high_resolution_clock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
 Application::Application(const char* caption, int width, int height)
 {
+	this->start_time = std::chrono::high_resolution_clock::now();
 	this->window = createWindow(caption, width, height);
+	this->caption = caption;
 
 	int w, h;
 	SDL_GetWindowSize(window, &w, &h);
@@ -18,34 +33,55 @@ Application::Application(const char* caption, int width, int height)
 	this->window_width = w;
 	this->window_height = h;
 	this->keystate = SDL_GetKeyboardState(nullptr);
+	this->jobs = JobSystem::Get();
+	this->assets = new AssetLoader(jobs);
 
 	this->framebuffer.Resize(w, h);
+	this->zbuffer.Resize(w, h);
 	this->canvas.Resize(w, h);
 	this->canvas.Fill(Color::BLACK);
+	this->history.Reset(canvas);
 
 }
 
 Application::~Application()
 {
+	delete assets; // Before the meshes and images it loads into
+	delete presenter;
+	delete entity;
+	delete mesh;
+	delete camera;
 }
 
 void Application::Init(void)
 {
 	std::cout << "Initiating app..." << std::endl;
 
+	// Streams the framebuffer to the window through a texture
+	presenter = new Presenter();
+	presenter->Init();
+
 	buttons.clear();
 
 	float y = framebuffer.height - 64.0f;
 	float x = 10.0f;
 	float step = 70.0f;
 
+	// Gray squares until the icons are loaded, all of them share the same area of the atlas
+	Image placeholder(32, 32);
+	placeholder.Fill(Color::GRAY);
+	icon_atlas.Clear();
+	Rect placeholder_icon = icon_atlas.Add(placeholder);
+	std::vector<const char*> icon_files;
+
 	auto addButton = [&](const char* filename, ButtonType type)
 		{
 			Button b;
-			b.icon.LoadPNG(filename, true); 
+			b.icon = placeholder_icon;
 			b.pos = Vector2(x, y);
 			b.type = type;
 			buttons.push_back(b);
+			icon_files.push_back(filename);
 			x += step;
 		};
 
@@ -70,6 +106,33 @@ void Application::Init(void)
 	addButton("images/clear.png", BTN_CLEAR);
 	addButton("images/load.png", BTN_LOAD);
 	addButton("images/save.png", BTN_SAVE);
+
+	// Every icon is packed in the atlas when it arrives and the area of its button is recomposited
+	for (size_t i = 0; i < buttons.size(); ++i)
+	{
+		std::shared_ptr<Image> icon = std::make_shared<Image>();
+		assets->LoadPNG(icon_files[i], icon.get(), true, [this, i, icon]() {
+			Button& b = buttons[i];
+			framebuffer.MarkDirty(Rect((int)b.pos.x, (int)b.pos.y, b.w(), b.h()));
+			b.icon = icon_atlas.Add(*icon);
+			framebuffer.MarkDirty(Rect((int)b.pos.x, (int)b.pos.y, b.w(), b.h()));
+		});
+	}
+
+	// ===== 3D SCENE =====
+	mesh = new Mesh();
+	assets->LoadOBJ("meshes/lee.obj", mesh);
+	entity = new Entity(mesh);
+
+	camera = new Camera();
+	camera->LookAt(Vector3(0.0f, 0.25f, 1.0f), Vector3(0.0f, 0.25f, 0.0f), Vector3::UP);
+	camera->SetPerspective(45.0f, window_width / (float)window_height, 0.01f, 100.0f);
+
+	if (!async_assets)
+	{
+		assets->WaitAll();
+		std::cout << "Assets loaded after " << msSince(start_time) << " ms" << std::endl;
+	}
 }
 
 
@@ -89,8 +152,27 @@ void Application::Render(void)
 
 	//framebuffer.DrawTriangle(a, b, c, Color::WHITE, true, Color::RED);  //proba triangle
 
-	// 1) mostrar lienzo
-	framebuffer.DrawImage(canvas, 0, 0);
+	if (mode == MODE_ANIM)
+	{
+		framebuffer.Fill(Color::BLACK);
+		zbuffer.Fill(FLT_MAX);
+		entity->Render(&framebuffer, camera, &zbuffer);
+		composited_pixels = framebuffer.dirty_rect.GetArea();
+		return; // The dirty rect is kept so the paint mode recomposites everything when it comes back
+	}
+
+	// 1) mostrar lienzo, only where the canvas changed, where the last preview was or what other modes wrote
+	Rect region = canvas.dirty_rect;
+	region.Union(overlay_rect);
+	region.Union(framebuffer.dirty_rect);
+	history.MarkChanged(canvas.dirty_rect);
+	canvas.ClearDirty();
+	framebuffer.ClearDirty();
+	framebuffer.DrawImage(canvas, 0, 0, region);
+
+	Rect composited = framebuffer.dirty_rect;
+	composited_pixels = composited.GetArea();
+	framebuffer.ClearDirty();
 
 	// 2) preview 
 	if (isDragging)
@@ -112,20 +194,78 @@ void Application::Render(void)
 			framebuffer.DrawTriangle(p0, p1, p2, currentColor, fillShapes, currentColor);
 		}
 	}
+	overlay_rect = framebuffer.dirty_rect;
 
-	// 3) toolbar
+	// 3) toolbar, only the buttons that were painted over
+	Rect covered = composited;
+	covered.Union(overlay_rect);
 	for (auto& b : buttons)
-		framebuffer.DrawImage(b.icon, (int)b.pos.x, (int)b.pos.y);
+		if (Rect((int)b.pos.x, (int)b.pos.y, b.w(), b.h()).Intersects(covered))
+			framebuffer.DrawImageArea(icon_atlas.image, b.icon, (int)b.pos.x, (int)b.pos.y);
 
+	framebuffer.MarkDirty(composited);
+}
+
+// Shows the framebuffer in the window, called after Render
+void Application::Present(void)
+{
+	// The profiler graph goes over the finished frame, the paint mode recomposites below it the next frame
+	if (show_profiler)
+		overlay_rect.Union(profiler.DrawOverlay(framebuffer, 10, 10));
 
-	framebuffer.Render();
+	presenter->Present(framebuffer, &framebuffer.dirty_rect);
+	if (!first_frame_presented)
+	{
+		first_frame_presented = true;
+		std::cout << "First frame after " << msSince(start_time) << " ms" << std::endl;
+	}
+	if (mode == MODE_PAINT)
+		framebuffer.ClearDirty();
 }
 
 
 // Called after render
 void Application::Update(float seconds_elapsed)
 {
+	FlushStroke();
+
+	if (assets->Update() > 0 && assets->GetPendingCount() == 0)
+		std::cout << "Assets loaded after " << msSince(start_time) << " ms" << std::endl;
+
+	if (mode == MODE_ANIM && entity)
+		entity->model.MakeRotationMatrix(time * 0.5f, Vector3::UP);
+
+	// Pixels recomposited and uploaded per frame, shown in the window title every second (the frames drawn, not the idle wake ups)
+	if (frame_rendered)
+	{
+		stats_composited += composited_pixels;
+		stats_uploaded += presenter->GetUploadedPixels();
+		stats_allocations += frame_allocations;
+		stats_frames++;
+	}
+	stats_time += seconds_elapsed;
+	if (stats_time >= 1.0f && stats_frames > 0)
+	{
+		// Written in a buffer of the frame arena, building it with strings would allocate
+		const size_t size = 1024;
+		char* title = frameArena().Allocate<char>(size);
+		int length = snprintf(title, size, "%s - recomposited %llu px/frame, uploaded %llu px/frame, %.1f allocs/frame - ", caption.c_str(),
+			stats_composited / stats_frames, stats_uploaded / stats_frames, stats_allocations / (float)stats_frames);
+		if (length > 0 && length < (int)size)
+			profiler.GetSummary(title + length, size - length);
+		SDL_SetWindowTitle(window, title);
+		stats_composited = stats_uploaded = stats_allocations = 0;
+		stats_frames = 0;
+		stats_time = 0.0f;
+	}
+}
 
+// False when the next frame would be the same as the last one, the loop waits for input instead of drawing it
+bool Application::NeedsRedraw(void) const
+{
+	// The 3D scene rotates every frame and the icons appear as they load, the paint mode changes only through the dirty rects
+	return mode == MODE_ANIM || !first_frame_presented || assets->GetPendingCount() > 0 ||
+		!canvas.dirty_rect.IsEmpty() || !framebuffer.dirty_rect.IsEmpty();
 }
 
 //keyboard press event 
@@ -149,6 +289,38 @@ void Application::OnKeyPressed(SDL_KeyboardEvent event)
 		fillShapes = !fillShapes;
 		break;
 
+	case SDLK_b:
+		currentTool = TOOL_BUCKET;
+		break;
+
+	// Ctrl+Z undoes, Ctrl+Y or Ctrl+Shift+Z redoes (not in the middle of a stroke, it is not a step yet)
+	case SDLK_z:
+	case SDLK_y:
+		if (!(event.keysym.mod & KMOD_CTRL) || isDragging)
+			break;
+		if (event.keysym.sym == SDLK_z && !(event.keysym.mod & KMOD_SHIFT))
+			history.Undo(canvas);
+		else
+			history.Redo(canvas);
+		break;
+
+	case SDLK_p:
+		show_profiler = !show_profiler;
+		break;
+
+	// The label tells apart the files of the runs to compare
+	case SDLK_l:
+	{
+		char label[128], summary[256];
+		snprintf(label, sizeof(label), "%s %s threads=%d max_fps=%d", continuous_rendering ? "continuous" : "event-driven",
+			presenter->IsStreaming() ? "texture" : "glDrawPixels", jobs->GetNumThreads(), max_fps);
+		latency.GetSummary(summary, sizeof(summary));
+		std::cout << label << ", " << summary << std::endl;
+		if (!latency.SaveCSV(latency_csv.c_str(), label))
+			std::cout << "Could not write " << latency_csv << std::endl;
+		break;
+	}
+
 	case SDLK_PLUS:
 	case SDLK_KP_PLUS:
 		borderWidth++;
@@ -166,6 +338,7 @@ void Application::OnKeyPressed(SDL_KeyboardEvent event)
 void Application::OnMouseButtonDown(SDL_MouseButtonEvent event)
 {
 	if (event.button != SDL_BUTTON_LEFT) return;
+	if (mode != MODE_PAINT) return;
 
 	// 1) click en botones
 	for (auto& b : buttons)
@@ -189,15 +362,24 @@ void Application::OnMouseButtonDown(SDL_MouseButtonEvent event)
 		case BTN_COLOR_CYAN:   currentColor = Color::CYAN;   return;
 
 
-		case BTN_CLEAR: canvas.Fill(Color::BLACK); return;
+		case BTN_CLEAR: canvas.Fill(Color::BLACK); history.Commit(canvas); return;
 
-		case BTN_LOAD:  canvas.LoadPNG("res/images/test.png", true); return; // luego lo haces bien
+		case BTN_LOAD:  canvas.LoadPNG("res/images/test.png", true); history.Commit(canvas); return; // luego lo haces bien
 		case BTN_SAVE:  canvas.SaveTGA("my_paint.tga"); return;
 		}
 	}
 
+	// The bucket fills on click, there is nothing to drag
+	if (currentTool == TOOL_BUCKET)
+	{
+		canvas.FloodFill((int)mouse_position.x, (int)mouse_position.y, currentColor, bucketTolerance);
+		history.Commit(canvas);
+		return;
+	}
+
 	// 2) empezar dibujo
 	isDragging = true;
+	latency.OnInput(event.timestamp);
 	startPos = mouse_position;
 	lastPos = mouse_position;
 	currentPos = mouse_position;
@@ -215,6 +397,8 @@ void Application::OnMouseButtonUp(SDL_MouseButtonEvent event)
 	if (event.button != SDL_BUTTON_LEFT) return;
 	if (!isDragging) return;
 
+	FlushStroke();
+
 	if (currentTool == TOOL_LINE)
 		canvas.DrawLineDDA((int)startPos.x, (int)startPos.y, (int)currentPos.x, (int)currentPos.y, currentColor);
 
@@ -231,6 +415,7 @@ void Application::OnMouseButtonUp(SDL_MouseButtonEvent event)
 		canvas.DrawTriangle(p0, p1, p2, currentColor, fillShapes, currentColor);
 	}
 
+	history.Commit(canvas);
 	isDragging = false;
 }
 
@@ -239,19 +424,25 @@ void Application::OnMouseMove(SDL_MouseButtonEvent event)
 {
 	currentPos = mouse_position;
 	if (!isDragging) return;
+	latency.OnInput(event.timestamp);
 
-	if (currentTool == TOOL_PENCIL)
+	// Several motion events can come in a frame, their segments are drawn in a single batch
+	if (currentTool == TOOL_PENCIL || currentTool == TOOL_ERASER)
 	{
-		canvas.DrawLineDDA((int)lastPos.x, (int)lastPos.y, (int)currentPos.x, (int)currentPos.y, currentColor);
-		lastPos = currentPos;
-	}
-	else if (currentTool == TOOL_ERASER)
-	{
-		canvas.DrawLineDDA((int)lastPos.x, (int)lastPos.y, (int)currentPos.x, (int)currentPos.y, Color::BLACK);
+		if (stroke.empty())
+			stroke.push_back(lastPos);
+		stroke.push_back(currentPos);
 		lastPos = currentPos;
 	}
 }
 
+void Application::FlushStroke()
+{
+	if (stroke.size() > 1)
+		canvas.DrawLines(&stroke[0], stroke.size(), currentTool == TOOL_ERASER ? Color::BLACK : currentColor);
+	stroke.clear();
+}
+
 
 void Application::OnWheel(SDL_MouseWheelEvent event)
 {
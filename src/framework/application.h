@@ -8,7 +8,20 @@
 #include "framework.h"
 #include "image.h"
 #include <vector>
-#include "button.h"   
+#include <string>
+#include <chrono>
+#include "button.h" 
+#include "atlas.h"
+#include "history.h"
+#include "latency.h"
+#include "profiler.h"   
+
+class Camera;
+class Mesh;
+class Entity;
+class Presenter;
+class JobSystem;
+class AssetLoader;
 
 
 class Application
@@ -18,6 +31,7 @@ public:
 	// Window
 
 	SDL_Window* window = nullptr;
+	std::string caption;
 	int window_width;
 	int window_height;
 
@@ -40,25 +54,67 @@ public:
 
 	// CPU Global framebuffer
 	Image framebuffer;
+	Presenter* presenter = nullptr; // Shows the framebuffer in the window
+
+	// Dirty rects: only the changed areas are recomposited and presented
+	Rect overlay_rect; // Area of the framebuffer with the preview of the last frame, drawn over the canvas
+	unsigned int composited_pixels = 0; // Pixels recomposited in the last frame
+	unsigned long long stats_composited = 0, stats_uploaded = 0, stats_allocations = 0;
+	unsigned int frame_allocations = 0; // Calls to operator new in the last frame, set by launchLoop
+	unsigned int stats_frames = 0;
+	float stats_time = 0.0f;
+
+	// By default the loop only draws when NeedsRedraw or some input came, otherwise it sleeps in SDL_WaitEventTimeout
+	bool continuous_rendering = false; // --continuous draws every frame like before
+	int max_fps = 0; // --max-fps N caps the frames per second (0 is no cap)
+	bool frame_rendered = false; // The last iteration of the loop drew a frame (otherwise it only handled events), set by launchLoop
+
+	// Time of every stage of the frame, the graph is toggled with P
+	Profiler profiler;
+	bool show_profiler = false;
+
+	// Time from the mouse events of the strokes to the present that shows them, L saves the histograms (--latency-csv file)
+	LatencyRecorder latency;
+	std::string latency_csv = "latency.csv";
+
+	// Worker threads for the image operations and the renderer (the one parallelFor uses), capped with --threads N
+	JobSystem* jobs = nullptr;
+
+	// Icons and meshes are loaded in the background, the first frame shows placeholders
+	// With async_assets false (--sync-assets) Init waits for them like before, to compare the time to the first frame
+	AssetLoader* assets = nullptr;
+	bool async_assets = true;
+	std::chrono::high_resolution_clock::time_point start_time;
+	bool first_frame_presented = false;
 
 	enum Mode { MODE_PAINT, MODE_ANIM };
-	enum Tool { TOOL_PENCIL, TOOL_ERASER, TOOL_LINE, TOOL_RECT, TOOL_TRI };
+	enum Tool { TOOL_PENCIL, TOOL_ERASER, TOOL_LINE, TOOL_RECT, TOOL_TRI, TOOL_BUCKET };
 
 	Mode mode = MODE_PAINT;
 	Tool currentTool = TOOL_PENCIL;
 
 	bool fillShapes = false;
+	int bucketTolerance = 0; // Max difference per channel with the clicked color that the bucket also fills
 
 	Color currentColor = Color::WHITE;
 
 	Image canvas;
+	CanvasHistory history; // Undo (Ctrl+Z) and redo (Ctrl+Y) of the canvas, a step per stroke, shape, fill, clear or load
 
 	bool isDragging = false;
 	Vector2 startPos;
 	Vector2 lastPos;
 	Vector2 currentPos;
+	std::vector<Vector2> stroke; // Pencil/eraser points moved since the last frame, drawn together by FlushStroke
 
 	std::vector<Button> buttons;
+	Atlas icon_atlas; // The icons of every button packed in one image
+
+	// 3D scene (MODE_ANIM), rendered with the software pipeline
+	Camera* camera = nullptr;
+	Mesh* mesh = nullptr;
+	Entity* entity = nullptr;
+	FloatImage zbuffer;
 
 	// Constructor and main methods
 	Application(const char* caption, int width, int height);
@@ -66,7 +122,10 @@ public:
 
 	void Init(void);
 	void Render(void);
+	void Present(void);
 	void Update(float dt);
+	void FlushStroke(void);
+	bool NeedsRedraw(void) const;
 
 
 
@@ -76,6 +135,7 @@ public:
 		this->window_width = width;
 		this->window_height = height;
 		this->framebuffer.Resize(width, height);
+		this->zbuffer.Resize(width, height);
 	}
 
 	Vector2 GetWindowSize()
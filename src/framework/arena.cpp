@@ -0,0 +1,126 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <algorithm>
+
+// Every new of the program goes through here to be counted
+static std::atomic<unsigned long long> s_allocation_count(0);
+
+void* operator new(size_t size)
+{
+	s_allocation_count++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+unsigned long long getAllocationCount()
+{
+	return s_allocation_count;
+}
+
+Arena::Arena(size_t capacity)
+{
+	Block block = { (char*)malloc(capacity), capacity, 0 };
+	blocks.push_back(block);
+	current = 0;
+	peak = 0;
+}
+
+Arena::~Arena()
+{
+	for (size_t i = 0; i < blocks.size(); ++i)
+		free(blocks[i].data);
+}
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+	while (true)
+	{
+		Block& block = blocks[current];
+		size_t start = (((size_t)block.data + block.offset + alignment - 1) & ~(alignment - 1)) - (size_t)block.data;
+		if (start + size <= block.size)
+		{
+			block.offset = start + size;
+			peak = std::max(peak, GetUsed());
+			return block.data + start;
+		}
+
+		// The next block (kept from a Release) or a new one twice as big as the last
+		if (current + 1 == blocks.size())
+		{
+			size_t capacity = std::max(blocks.back().size * 2, size + alignment);
+			Block new_block = { (char*)malloc(capacity), capacity, 0 };
+			blocks.push_back(new_block);
+		}
+		current++;
+		blocks[current].offset = 0;
+	}
+}
+
+void Arena::Release(const Arena::Marker& marker)
+{
+	current = marker.block;
+	blocks[current].offset = marker.offset;
+}
+
+void Arena::Reset()
+{
+	if (blocks.size() > 1)
+	{
+		size_t capacity = GetCapacity();
+		for (size_t i = 0; i < blocks.size(); ++i)
+			free(blocks[i].data);
+		blocks.resize(1);
+		blocks[0].data = (char*)malloc(capacity);
+		blocks[0].size = capacity;
+	}
+	current = 0;
+	blocks[0].offset = 0;
+}
+
+size_t Arena::GetUsed() const
+{
+	size_t used = blocks[current].offset;
+	for (size_t i = 0; i < current; ++i)
+		used += blocks[i].size;
+	return used;
+}
+
+size_t Arena::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (size_t i = 0; i < blocks.size(); ++i)
+		capacity += blocks[i].size;
+	return capacity;
+}
+
+Arena& frameArena()
+{
+	static Arena arena(1024 * 1024);
+	return arena;
+}
+
+Arena& scratchArena()
+{
+	static thread_local Arena arena;
+	return arena;
+}
@@ -0,0 +1,81 @@
+/*
+	+ An Arena gives temporary memory by moving an offset forward, everything is released at once (no delete per allocation).
+	+ frameArena() is for data that lives until the end of the frame (main thread only), launchLoop resets it after every frame.
+	+ scratchArena() is a different arena per thread for data used inside a function, an ArenaScope gives back what was taken in its scope.
+	+ getAllocationCount() counts the calls to operator new, a frame that does not change it did not touch the heap.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+class Arena
+{
+public:
+	// Position of the arena, what is allocated after it can be released with Release
+	struct Marker
+	{
+		size_t block;
+		size_t offset;
+	};
+
+	Arena(size_t capacity = 64 * 1024);
+	~Arena();
+
+	// Uninitialized memory, nothing is constructed or destroyed (use it for plain data)
+	// When the current block is full another one is added, the memory given before stays valid
+	void* Allocate(size_t size, size_t alignment = 16);
+	template <typename T> T* Allocate(size_t count) { return (T*)Allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16); }
+
+	Marker GetMarker() const { Marker marker = { current, blocks[current].offset }; return marker; }
+	void Release(const Marker& marker);
+
+	// Releases everything, if more than one block was needed they become a single one that fits all of them,
+	// so after the first frames the same use does not allocate again
+	void Reset();
+
+	size_t GetUsed() const;
+	size_t GetPeak() const { return peak; }
+	size_t GetCapacity() const;
+
+private:
+	// Not copyable, the blocks belong to a single arena
+	Arena(const Arena&);
+	Arena& operator = (const Arena&);
+
+	struct Block
+	{
+		char* data;
+		size_t size;
+		size_t offset;
+	};
+
+	std::vector<Block> blocks;
+	size_t current;
+	size_t peak;
+};
+
+// Gives back to the arena everything allocated during the life of the scope
+class ArenaScope
+{
+public:
+	ArenaScope(Arena& arena) : arena(arena), marker(arena.GetMarker()) {}
+	~ArenaScope() { arena.Release(marker); }
+
+private:
+	ArenaScope(const ArenaScope&);
+	ArenaScope& operator = (const ArenaScope&);
+
+	Arena& arena;
+	Arena::Marker marker;
+};
+
+// Arena of the frame, only for the main thread
+Arena& frameArena();
+
+// Arena of the calling thread, use it inside an ArenaScope
+Arena& scratchArena();
+
+// Number of calls to operator new (all threads) since the program started
+unsigned long long getAllocationCount();
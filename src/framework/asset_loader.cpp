@@ -0,0 +1,80 @@
+#include "asset_loader.h"
+#include "image.h"
+#include "mesh.h"
+
+AssetLoader::AssetLoader(JobSystem* jobs)
+{
+	this->jobs = jobs;
+}
+
+AssetLoader::~AssetLoader()
+{
+	// The jobs own what they load, only their results are dropped
+	for (size_t i = 0; i < pending.size(); ++i)
+		jobs->Wait(pending[i].job);
+}
+
+JobHandle AssetLoader::LoadPNG(const char* filename, Image* target, bool flip_y, const std::function<void()>& on_loaded)
+{
+	std::shared_ptr<Image> image = std::make_shared<Image>();
+	std::shared_ptr<bool> loaded = std::make_shared<bool>(false);
+	std::string path = filename;
+
+	PendingAsset asset;
+	asset.loaded = loaded;
+	asset.apply = [image, target]() { target->Swap(*image); };
+	asset.on_loaded = on_loaded;
+	asset.job = jobs->Submit([image, loaded, path, flip_y]() { *loaded = image->LoadPNG(path.c_str(), flip_y); });
+	pending.push_back(asset);
+	return asset.job;
+}
+
+JobHandle AssetLoader::LoadOBJ(const char* filename, Mesh* target, const std::function<void()>& on_loaded)
+{
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+	std::shared_ptr<bool> loaded = std::make_shared<bool>(false);
+	std::string path = filename;
+
+	PendingAsset asset;
+	asset.loaded = loaded;
+	asset.apply = [mesh, target]() { target->Swap(*mesh); };
+	asset.on_loaded = on_loaded;
+	asset.job = jobs->Submit([mesh, loaded, path]() { *loaded = mesh->LoadOBJ(path.c_str()); });
+	pending.push_back(asset);
+	return asset.job;
+}
+
+int AssetLoader::Update()
+{
+	int count = 0;
+	for (size_t i = 0; i < pending.size();)
+	{
+		if (!jobs->IsDone(pending[i].job))
+		{
+			++i;
+			continue;
+		}
+
+		// Removed before the callback, it could queue more loads
+		PendingAsset asset = pending[i];
+		pending.erase(pending.begin() + i);
+		if (!*asset.loaded)
+			continue;
+
+		asset.apply();
+		if (asset.on_loaded)
+			asset.on_loaded();
+		count++;
+	}
+	return count;
+}
+
+void AssetLoader::WaitAll()
+{
+	while (!pending.empty())
+	{
+		for (size_t i = 0; i < pending.size(); ++i)
+			jobs->Wait(pending[i].job);
+		Update();
+	}
+}
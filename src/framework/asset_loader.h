@@ -0,0 +1,52 @@
+/*
+	+ The AssetLoader reads images and meshes in the jobs of the JobSystem so the application can start before they are ready.
+	+ The target keeps its placeholder until Update (called from the main thread every frame) swaps the loaded asset into it.
+	+ The jobs never touch the targets, so they can be drawn while loading. Without worker threads the loads run when they are requested.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include "jobsystem.h"
+
+class Image;
+class Mesh;
+
+class AssetLoader
+{
+public:
+	AssetLoader(JobSystem* jobs);
+	~AssetLoader();
+
+	// Queue the load, on_loaded runs in the main thread right after the asset is swapped into target (not called if it fails)
+	// The target must stay alive until then, the handle tells when the file has been read
+	JobHandle LoadPNG(const char* filename, Image* target, bool flip_y = true, const std::function<void()>& on_loaded = nullptr);
+	JobHandle LoadOBJ(const char* filename, Mesh* target, const std::function<void()>& on_loaded = nullptr);
+
+	// Swaps the finished assets into their targets, returns how many
+	int Update();
+
+	// Blocks until every queued asset is in its target
+	void WaitAll();
+
+	int GetPendingCount() const { return (int)pending.size(); }
+
+private:
+	// Not copyable, the pending loads belong to a single loader
+	AssetLoader(const AssetLoader&);
+	AssetLoader& operator = (const AssetLoader&);
+
+	struct PendingAsset
+	{
+		JobHandle job;
+		std::shared_ptr<bool> loaded;
+		std::function<void()> apply; // Swaps the asset into the target
+		std::function<void()> on_loaded;
+	};
+
+	JobSystem* jobs;
+	std::vector<PendingAsset> pending;
+};
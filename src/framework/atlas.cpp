@@ -0,0 +1,70 @@
+#include "atlas.h"
+
+#include <algorithm>
+
+Atlas::Atlas(unsigned int width, unsigned int height, int padding)
+	: image(width, height)
+{
+	this->padding = padding;
+	used_height = 0;
+}
+
+Rect Atlas::Add(const Image& source)
+{
+	const int w = (int)source.width + padding;
+	const int h = (int)source.height + padding;
+	if (source.width == 0 || source.height == 0)
+		return Rect();
+
+	// Wider than the atlas: the atlas gets as wide as the image, the shelves just have more room
+	if (w > (int)image.width)
+		image.Resize(w, image.height);
+
+	// First shelf tall enough with room left, the images shorter than half a shelf open a new one to not waste it
+	Shelf* shelf = NULL;
+	for (size_t i = 0; i < shelves.size() && !shelf; ++i)
+		if (shelves[i].height >= h && shelves[i].height / 2 < h && shelves[i].used_width + w <= (int)image.width)
+			shelf = &shelves[i];
+
+	if (!shelf)
+	{
+		unsigned int needed = used_height + h;
+		if (needed > image.height)
+		{
+			unsigned int new_height = image.height;
+			while (new_height < needed)
+				new_height *= 2;
+			image.Resize(image.width, new_height);
+		}
+
+		Shelf new_shelf = { used_height, h, 0 };
+		shelves.push_back(new_shelf);
+		used_height += h;
+		shelf = &shelves.back();
+	}
+
+	Rect area(shelf->used_width, shelf->y, source.width, source.height);
+	shelf->used_width += w;
+
+	image.DrawImage(source, area.x, area.y);
+	return area;
+}
+
+void Atlas::Add(const std::vector<const Image*>& images, std::vector<Rect>& areas)
+{
+	std::vector<size_t> order(images.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return images[a]->height > images[b]->height; });
+
+	areas.resize(images.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		areas[order[i]] = Add(*images[order[i]]);
+}
+
+void Atlas::Clear()
+{
+	shelves.clear();
+	used_height = 0;
+	image.Fill(Color::BLACK);
+}
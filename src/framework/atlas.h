@@ -0,0 +1,41 @@
+/*
+	+ An Atlas packs many small images (icons, glyphs...) into a single big one, each of them is then an area of that image.
+	+ The areas are placed in shelves: rows as tall as their tallest image, filled from left to right.
+	+ Drawing from the atlas (Image::DrawImageArea) touches a single block of memory instead of one per image.
+*/
+
+#pragma once
+
+#include <vector>
+#include "framework.h"
+#include "image.h"
+
+class Atlas
+{
+public:
+	Image image;
+
+	// The height grows (doubling) when the images do not fit, the areas already given stay valid
+	Atlas(unsigned int width = 256, unsigned int height = 256, int padding = 1);
+
+	// Copies the image into a free area of the atlas and returns that area
+	Rect Add(const Image& image);
+
+	// Adds several images at once, tallest first so the shelves waste less space, areas[i] is the area of images[i]
+	void Add(const std::vector<const Image*>& images, std::vector<Rect>& areas);
+
+	// Removes every image, the areas given before are not valid anymore
+	void Clear();
+
+private:
+	struct Shelf
+	{
+		int y;
+		int height;
+		int used_width;
+	};
+
+	std::vector<Shelf> shelves;
+	int padding;
+	int used_height;
+};
@@ -0,0 +1,708 @@
+#include "benchmark.h"
+#include "utils.h"
+#include "mesh.h"
+#include "image.h"
+#include "mapped_file.h"
+#include "../extra/picopng.h"
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+
+// Milliseconds elapsed since start
+static double elapsedMs(const std::chrono::high_resolution_clock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Best time of several runs of the callback (in milliseconds)
+template <typename F>
+static double bestOf(int runs, F callback)
+{
+	double best = 1e30;
+	for (int i = 0; i < runs; ++i)
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		callback();
+		best = std::min(best, elapsedMs(start));
+	}
+	return best;
+}
+
+static const char* s_bundled_meshes[] = { "meshes/anna.obj", "meshes/cleo.obj", "meshes/lee.obj" };
+
+// ***** OBJ loading *****
+
+// The tokenizer based OBJ parser that Mesh::LoadOBJ used before, kept as reference
+static bool loadOBJTokenizer(const char* filename, std::vector<Vector3>& vertices, std::vector<Vector3>& normals, std::vector<Vector2>& uvs)
+{
+	struct stat stbuffer;
+	std::string relPath = absResPath(filename);
+
+	FILE* f = fopen(relPath.c_str(), "rb");
+	if (f == NULL)
+	{
+		std::cerr << "File not found: " << filename << std::endl;
+		return false;
+	}
+
+	stat(relPath.c_str(), &stbuffer);
+
+	unsigned int size = stbuffer.st_size;
+	char* data = new char[size + 1];
+	fread(data, size, 1, f);
+	fclose(f);
+	data[size] = 0;
+
+	char* pos = data;
+	char line[255];
+	int i = 0;
+
+	std::vector<Vector3> indexed_positions;
+	std::vector<Vector3> indexed_normals;
+	std::vector<Vector2> indexed_uvs;
+
+	const float max_float = 10000000;
+	const float min_float = -10000000;
+
+	unsigned int vertex_i = 0;
+
+	//parse file
+	while (*pos != 0)
+	{
+		if (*pos == '\n') pos++;
+		if (*pos == '\r') pos++;
+
+		//read one line
+		i = 0;
+		while (i < 255 && pos[i] != '\n' && pos[i] != '\r' && pos[i] != 0) i++;
+		std::memcpy(line, pos, i);
+		line[i] = 0;
+		pos = pos + i;
+
+		//std::cout << "Line: \"" << line << "\"" << std::endl;
+		if (*line == '#' || *line == 0) continue; //comment
+
+		//tokenize line
+		std::vector<std::string> tokens = tokenize(line, " ");
+
+		if (tokens.empty()) continue;
+
+		if (tokens[0] == "v" && tokens.size() == 4)
+		{
+			Vector3 v(std::stof(tokens[1].c_str()), std::stof(tokens[2].c_str()), std::stof(tokens[3].c_str()));
+			indexed_positions.push_back(v);
+		}
+		else if (tokens[0] == "vt" && (tokens.size() == 4 || tokens.size() == 3))
+		{
+			Vector2 v(std::stof(tokens[1].c_str()), std::stof(tokens[2].c_str()));
+			indexed_uvs.push_back(v);
+		}
+		else if (tokens[0] == "vn" && tokens.size() == 4)
+		{
+			Vector3 v(std::stof(tokens[1].c_str()), std::stof(tokens[2].c_str()), std::stof(tokens[3].c_str()));
+			indexed_normals.push_back(v);
+		}
+		else if (tokens[0] == "f" && tokens.size() >= 4)
+		{
+			Vector3 v1, v2, v3;
+			v1 = parseVector3(tokens[1].c_str(), '/');
+
+			for (size_t iPoly = 2; iPoly < tokens.size() - 1; iPoly++)
+			{
+				v2 = parseVector3(tokens[iPoly].c_str(), '/');
+				v3 = parseVector3(tokens[iPoly + 1].c_str(), '/');
+
+				vertices.push_back(indexed_positions[(unsigned int)(v1.x) - 1]);
+				vertices.push_back(indexed_positions[(unsigned int)(v2.x) - 1]);
+				vertices.push_back(indexed_positions[(unsigned int)(v3.x) - 1]);
+				//triangles.push_back( VECTOR_INDICES_TYPE(vertex_i, vertex_i+1, vertex_i+2) ); //not needed
+				vertex_i += 3;
+
+				if (indexed_uvs.size() > 0)
+				{
+					uvs.push_back(indexed_uvs[(unsigned int)(v1.y) - 1]);
+					uvs.push_back(indexed_uvs[(unsigned int)(v2.y) - 1]);
+					uvs.push_back(indexed_uvs[(unsigned int)(v3.y) - 1]);
+				}
+
+				if (indexed_normals.size() > 0)
+				{
+					normals.push_back(indexed_normals[(unsigned int)(v1.z) - 1]);
+					normals.push_back(indexed_normals[(unsigned int)(v2.z) - 1]);
+					normals.push_back(indexed_normals[(unsigned int)(v3.z) - 1]);
+				}
+			}
+		}
+	}
+
+	delete[] data;
+
+	return true;
+}
+
+
+static void benchmarkOBJ()
+{
+	std::cout << "*** OBJ loading (best of 5 runs)" << std::endl;
+
+	for (const char* filename : s_bundled_meshes)
+	{
+		std::vector<Vector3> vertices, normals;
+		std::vector<Vector2> uvs;
+		double reference = bestOf(5, [&]() {
+			vertices.clear(); normals.clear(); uvs.clear();
+			loadOBJTokenizer(filename, vertices, normals, uvs);
+		});
+
+		Mesh mesh;
+		double mapped = bestOf(5, [&]() { mesh.LoadOBJ(filename, false); });
+
+		std::cout << filename << ": tokenizer " << reference << " ms, mapped " << mapped << " ms (x" << reference / mapped << ")"
+			<< ", " << vertices.size() << " vertices welded to " << mesh.GetVertices().size()
+			<< (mesh.GetTriangleCount() * 3 == vertices.size() ? "" : " TRIANGLE COUNT MISMATCH") << std::endl;
+	}
+}
+
+// ***** Mesh cache *****
+
+static void benchmarkMeshCache()
+{
+	std::cout << "*** Mesh startup, OBJ parsing vs binary cache (best of 5 runs)" << std::endl;
+
+	for (const char* filename : s_bundled_meshes)
+	{
+		// The first load writes (or refreshes) the cache
+		Mesh parsed;
+		double first = bestOf(1, [&]() { parsed.LoadOBJ(filename); });
+		double parse = bestOf(5, [&]() { parsed.LoadOBJ(filename, false); });
+
+		Mesh cached;
+		double load = bestOf(5, [&]() { cached.LoadOBJ(filename); });
+
+		bool same = parsed.GetVertices().size() == cached.GetVertices().size() && parsed.GetIndices() == cached.GetIndices() &&
+			memcmp(parsed.GetVertices().data(), cached.GetVertices().data(), parsed.GetVertices().size() * sizeof(Vector3)) == 0;
+
+		std::cout << filename << ": parse " << parse << " ms, first run with cache write " << first << " ms, cached " << load
+			<< " ms (x" << parse / load << ")" << (same ? "" : " CACHE MISMATCH") << std::endl;
+	}
+}
+
+// ***** Image blits *****
+
+// Per pixel versions that DrawImage, GetArea and Resize used before, kept as reference
+static void drawImagePerPixel(Image& dst, const Image& img, int x, int y)
+{
+	for (int j = 0; j < (int)img.height; j++)
+		for (int i = 0; i < (int)img.width; i++)
+		{
+			int px = x + i, py = y + j;
+			if (px < 0 || px >= (int)dst.width || py < 0 || py >= (int)dst.height)
+				continue;
+			dst.SetPixel((unsigned int)px, (unsigned int)py, img.GetPixel(i, j));
+		}
+}
+
+static Image getAreaPerPixel(const Image& src, unsigned int start_x, unsigned int start_y, unsigned int width, unsigned int height)
+{
+	Image result(width, height);
+	for (unsigned int x = 0; x < width; ++x)
+		for (unsigned int y = 0; y < height; ++y)
+			if ((x + start_x) < src.width && (y + start_y) < src.height)
+				result.SetPixelUnsafe(x, y, src.GetPixel(x + start_x, y + start_y));
+	return result;
+}
+
+static void resizePerPixel(Image& image, unsigned int width, unsigned int height)
+{
+	Image result(width, height);
+	for (unsigned int x = 0; x < std::min(width, image.width); ++x)
+		for (unsigned int y = 0; y < std::min(height, image.height); ++y)
+			result.SetPixelUnsafe(x, y, image.GetPixel(x, y));
+	image = result;
+}
+
+static void benchmarkBlit()
+{
+	std::cout << "*** Image blits at 1920x1080 (best of 10 runs)" << std::endl;
+
+	Image source(1920, 1080), target(1920, 1080);
+	for (unsigned int y = 0; y < source.height; ++y)
+		for (unsigned int x = 0; x < source.width; ++x)
+			source.SetPixelUnsafe(x, y, Color(x, y, x + y));
+
+	auto report = [](const char* name, double reference, double blit, bool same) {
+		std::cout << name << ": per pixel " << reference << " ms, rows " << blit << " ms (x" << reference / blit << ")" << (same ? "" : " MISMATCH") << std::endl;
+	};
+	auto equal = [](const Image& a, const Image& b) {
+		return a.width == b.width && a.height == b.height && memcmp(a.pixels, b.pixels, a.width * a.height * sizeof(Color)) == 0;
+	};
+
+	// Full image and partially outside (clipped on two sides)
+	Image expected(target);
+	double reference = bestOf(10, [&]() { drawImagePerPixel(expected, source, 0, 0); });
+	double blit = bestOf(10, [&]() { target.DrawImage(source, 0, 0); });
+	report("DrawImage full", reference, blit, equal(expected, target));
+
+	reference = bestOf(10, [&]() { drawImagePerPixel(expected, source, -300, 200); });
+	blit = bestOf(10, [&]() { target.DrawImage(source, -300, 200); });
+	report("DrawImage clipped", reference, blit, equal(expected, target));
+
+	Image area_reference, area;
+	reference = bestOf(10, [&]() { area_reference = getAreaPerPixel(source, 960, 540, 1280, 720); });
+	blit = bestOf(10, [&]() { area = source.GetArea(960, 540, 1280, 720); });
+	report("GetArea 1280x720", reference, blit, equal(area_reference, area));
+
+	Image resized_reference, resized;
+	reference = bestOf(10, [&]() { resized_reference = source; resizePerPixel(resized_reference, 1280, 1280); });
+	blit = bestOf(10, [&]() { resized = source; resized.Resize(1280, 1280); });
+	report("Resize to 1280x1280 (with a copy)", reference, blit, equal(resized_reference, resized));
+}
+
+// ***** Matrix math *****
+
+// The scalar versions that framework.cpp had before the SSE code, kept as reference
+static Matrix44 multiplyScalar(const Matrix44& a, const Matrix44& b)
+{
+	Matrix44 ret;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+		{
+			ret.M[i][j] = 0.0;
+			for (int k = 0; k < 4; k++)
+				ret.M[i][j] += a.M[k][j] * b.M[i][k];
+		}
+	return ret;
+}
+
+// The vertex loop of Entity::Render
+static void transformScalar(const Matrix44& matrix, const Vector3* in, Vector4* out, size_t n)
+{
+	const float* m = matrix.m;
+	for (size_t i = 0; i < n; ++i)
+	{
+		const float x = in[i].x, y = in[i].y, z = in[i].z;
+		out[i].x = m[0] * x + m[4] * y + m[8] * z + m[12];
+		out[i].y = m[1] * x + m[5] * y + m[9] * z + m[13];
+		out[i].z = m[2] * x + m[6] * y + m[10] * z + m[14];
+		out[i].w = m[3] * x + m[7] * y + m[11] * z + m[15];
+	}
+}
+
+// Gauss-Jordan elimination with partial pivoting
+static bool inverseScalar(Matrix44& matrix)
+{
+	Matrix44 temp = matrix, result;
+	for (int i = 0; i < 4; i++)
+	{
+		int swap = i;
+		for (int j = i + 1; j < 4; j++)
+			if (fabsf(temp.M[j][i]) > fabsf(temp.M[swap][i]))
+				swap = j;
+		for (int k = 0; k < 4 && swap != i; k++)
+		{
+			std::swap(temp.M[i][k], temp.M[swap][k]);
+			std::swap(result.M[i][k], result.M[swap][k]);
+		}
+		if (fabsf(temp.M[i][i]) <= 0.00001f)
+			return false;
+
+		float t = 1.0f / temp.M[i][i];
+		for (int k = 0; k < 4; k++)
+		{
+			temp.M[i][k] *= t;
+			result.M[i][k] *= t;
+		}
+		for (int j = 0; j < 4; j++)
+		{
+			if (j == i)
+				continue;
+			t = temp.M[j][i];
+			for (int k = 0; k < 4; k++)
+			{
+				temp.M[j][k] -= temp.M[i][k] * t;
+				result.M[j][k] -= result.M[i][k] * t;
+			}
+		}
+	}
+	matrix = result;
+	return true;
+}
+
+static float maxDifference(const float* a, const float* b, size_t n)
+{
+	float diff = 0.0f;
+	for (size_t i = 0; i < n; ++i)
+		diff = std::max(diff, fabsf(a[i] - b[i]));
+	return diff;
+}
+
+static void benchmarkMath()
+{
+#ifdef FRAMEWORK_SSE
+	std::cout << "*** Matrix math, scalar vs SSE (best of 10 runs)" << std::endl;
+#else
+	std::cout << "*** Matrix math, scalar vs scalar (FRAMEWORK_SSE disabled, best of 10 runs)" << std::endl;
+#endif
+
+	Mesh mesh;
+	if (!mesh.LoadOBJ("meshes/lee.obj"))
+		return;
+	const std::vector<Vector3>& vertices = mesh.GetVertices();
+	const size_t n = vertices.size();
+
+	// A model view projection like the one of the application
+	Matrix44 model, view, projection;
+	model.MakeRotationMatrix(0.7f, Vector3(0.2f, 1.0f, 0.1f));
+	view.MakeTranslationMatrix(0.1f, -0.25f, -1.0f);
+	projection.Set(1.3f, 0, 0, 0, 0, 2.4f, 0, 0, 0, 0, -1.0002f, -0.020002f, 0, 0, -1, 0);
+	Matrix44 mvp = projection * view * model;
+
+	std::vector<Vector4> expected(n), result(n);
+	double reference = bestOf(10, [&]() { transformScalar(mvp, &vertices[0], &expected[0], n); });
+	double simd = bestOf(10, [&]() { mvp.TransformPoints(&vertices[0], &result[0], n); });
+	std::cout << "TransformPoints " << n << " vertices: per vertex " << reference << " ms, batch " << simd << " ms (x" << reference / simd << ")"
+		<< ", max error " << maxDifference(expected[0].v, result[0].v, n * 4) << std::endl;
+
+	// Many small operations, the results are accumulated so they are not optimized away
+	const int count = 100000;
+	std::vector<Matrix44> matrices(64);
+	for (size_t i = 0; i < matrices.size(); ++i)
+	{
+		matrices[i].MakeRotationMatrix(i * 0.1f, Vector3(1.0f, i * 0.5f, 0.3f));
+		matrices[i] = projection * matrices[i];
+		matrices[i].M[3][0] = i * 0.01f;
+	}
+
+	Matrix44 product_reference, product;
+	reference = bestOf(10, [&]() { product_reference = mvp; for (int i = 0; i < count; ++i) product_reference = multiplyScalar(matrices[i & 63], product_reference); });
+	simd = bestOf(10, [&]() { product = mvp; for (int i = 0; i < count; ++i) product = matrices[i & 63] * product; });
+	std::cout << "Matrix44 * Matrix44 x" << count << ": before " << reference << " ms, now " << simd << " ms (x" << reference / simd << ")" << std::endl;
+
+	float error = 0.0f;
+	Matrix44 inverse_reference, inverse;
+	reference = bestOf(10, [&]() { for (int i = 0; i < count; ++i) { inverse_reference = matrices[i & 63]; inverseScalar(inverse_reference); } });
+	simd = bestOf(10, [&]() { for (int i = 0; i < count; ++i) { inverse = matrices[i & 63]; inverse.Inverse(); } });
+	for (size_t i = 0; i < matrices.size(); ++i)
+	{
+		inverse_reference = matrices[i];
+		inverse = matrices[i];
+		inverseScalar(inverse_reference);
+		inverse.Inverse();
+		error = std::max(error, maxDifference(inverse_reference.m, inverse.m, 16));
+	}
+	std::cout << "Matrix44::Inverse x" << count << ": Gauss-Jordan " << reference << " ms, now " << simd << " ms (x" << reference / simd << ")"
+		<< ", max error " << error << std::endl;
+}
+
+// ***** Per pixel filters *****
+
+static void benchmarkForEachPixel()
+{
+	std::cout << "*** ForEachPixel on a 3840x2160 image (best of 10 runs)" << std::endl;
+
+	Image image(3840, 2160), other(3840, 2160);
+	for (unsigned int y = 0; y < image.height; ++y)
+		for (unsigned int x = 0; x < image.width; ++x)
+		{
+			image.SetPixelUnsafe(x, y, Color(x, y, x ^ y));
+			other.SetPixelUnsafe(x, y, Color(y, x, x + y));
+		}
+
+	// A brightness/contrast filter and a blend of two images
+	auto filter = [](Color c) { return Color(clamp(c.r * 1.2f - 20.0f, 0.0f, 255.0f), clamp(c.g * 1.2f - 20.0f, 0.0f, 255.0f), clamp(c.b * 1.2f - 20.0f, 0.0f, 255.0f)); };
+	auto blend = [](Color a, Color b) { return Color((a.r + b.r) >> 1, (a.g + b.g) >> 1, (a.b + b.b) >> 1); };
+
+	const char* names[] = { "sequenced", "parallel", "parallel unsequenced" };
+	Image expected(image);
+	expected.ForEachPixel(filter);
+	Image expected_blend(image);
+	ForEachPixel(expected_blend, other, blend);
+
+	Image result;
+	double reference = bestOf(10, [&]() { result = image; result.ForEachPixel(filter); });
+	std::cout << "filter, no policy: " << reference << " ms" << std::endl;
+	for (int policy = EXECUTION_SEQUENCED; policy <= EXECUTION_PARALLEL_UNSEQUENCED; ++policy)
+	{
+		double time = bestOf(10, [&]() { result = image; result.ForEachPixel((ExecutionPolicy)policy, filter); });
+		bool same = memcmp(result.pixels, expected.pixels, image.width * image.height * sizeof(Color)) == 0;
+		std::cout << "filter, " << names[policy] << ": " << time << " ms (x" << reference / time << ")" << (same ? "" : " MISMATCH") << std::endl;
+	}
+
+	reference = bestOf(10, [&]() { result = image; ForEachPixel(result, other, blend); });
+	std::cout << "blend, no policy: " << reference << " ms" << std::endl;
+	for (int policy = EXECUTION_SEQUENCED; policy <= EXECUTION_PARALLEL_UNSEQUENCED; ++policy)
+	{
+		double time = bestOf(10, [&]() { result = image; ForEachPixel((ExecutionPolicy)policy, result, other, blend); });
+		bool same = memcmp(result.pixels, expected_blend.pixels, image.width * image.height * sizeof(Color)) == 0;
+		std::cout << "blend, " << names[policy] << ": " << time << " ms (x" << reference / time << ")" << (same ? "" : " MISMATCH") << std::endl;
+	}
+}
+
+// ***** PNG decoding *****
+
+static const char* s_bundled_pngs[] = { "images/fruits.png", "images/pencil.png", "images/save.png" };
+
+// What LoadPNG did before: 32 bit decode, copy of the RGB channels and a flip of the rows
+static void decodePNGLegacy(const unsigned char* data, size_t size, Image& image)
+{
+	std::vector<unsigned char> rgba;
+	decodePNG(rgba, image.width, image.height, data, size);
+	delete[] image.pixels;
+	image.pixels = new Color[image.width * image.height];
+	for (unsigned int i = 0; i < image.width * image.height; ++i)
+		image.pixels[i] = Color(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]);
+	image.FlipY();
+}
+
+static void benchmarkPNG()
+{
+	std::cout << "*** PNG decoding (best of 10 runs)" << std::endl;
+
+	for (const char* filename : s_bundled_pngs)
+	{
+		MappedFile file;
+		if (!file.Open(absResPath(filename)))
+			continue;
+		const unsigned char* data = (const unsigned char*)file.GetData();
+
+		Image legacy;
+		double reference = bestOf(10, [&]() { decodePNGLegacy(data, file.GetSize(), legacy); });
+
+		unsigned int width, height;
+		decodePNG(NULL, width, height, data, file.GetSize());
+		std::vector<Color> pixels(width * height);
+		double direct = bestOf(10, [&]() { decodePNG((unsigned char*)&pixels[0], width, height, data, file.GetSize(), true); });
+
+		bool same = width == legacy.width && height == legacy.height && memcmp(&pixels[0], legacy.pixels, width * height * sizeof(Color)) == 0;
+		std::cout << filename << " (" << width << "x" << height << "): 32 bit decode + copy + flip " << reference << " ms, direct " << direct
+			<< " ms (x" << reference / direct << ")" << (same ? "" : " MISMATCH") << std::endl;
+	}
+}
+
+// ***** Lines *****
+
+// What DrawLineDDA did before: float steps over the whole line and a bounds test per pixel
+static void drawLineDDALegacy(Image& image, int x0, int y0, int x1, int y1, const Color& c)
+{
+	int dx = x1 - x0, dy = y1 - y0;
+	int steps = std::max(abs(dx), abs(dy));
+	float x = (float)x0, y = (float)y0;
+	float x_inc = dx / (float)steps, y_inc = dy / (float)steps;
+	for (int i = 0; i <= steps; i++)
+	{
+		if (x >= 0 && x < image.width && y >= 0 && y < image.height)
+			image.SetPixel((int)x, (int)y, c);
+		x += x_inc;
+		y += y_inc;
+	}
+}
+
+static void benchmarkLines()
+{
+	std::cout << "*** Lines on a 1920x1080 image (best of 10 runs)" << std::endl;
+
+	const int num_lines = 20000;
+	Image image(1920, 1080);
+
+	// Short strokes like the pencil, and long lines with the ends anywhere in an area 3 times the image (mostly clipped)
+	std::vector<Vector2> strokes(num_lines + 1), ends(num_lines * 2);
+	strokes[0].set(960, 540);
+	for (int i = 1; i <= num_lines; ++i)
+	{
+		Vector2 p = strokes[i - 1] + Vector2(randomValue() * 40.0f - 20.0f, randomValue() * 40.0f - 20.0f);
+		strokes[i].set(clamp(p.x, 0.0f, 1919.0f), clamp(p.y, 0.0f, 1079.0f));
+	}
+	for (size_t i = 0; i < ends.size(); ++i)
+		ends[i].set(randomValue() * 5760.0f - 1920.0f, randomValue() * 3240.0f - 1080.0f);
+
+	auto report = [&](const char* name, double legacy, double clipped) {
+		std::cout << name << ": DDA " << num_lines / legacy * 0.001 << " M lines/s, clipped " << num_lines / clipped * 0.001
+			<< " M lines/s (x" << legacy / clipped << ")" << std::endl;
+	};
+
+	double legacy = bestOf(10, [&]() {
+		for (int i = 0; i < num_lines; ++i)
+			drawLineDDALegacy(image, (int)strokes[i].x, (int)strokes[i].y, (int)strokes[i + 1].x, (int)strokes[i + 1].y, Color::WHITE);
+	});
+	double clipped = bestOf(10, [&]() {
+		for (int i = 0; i < num_lines; ++i)
+			image.DrawLineDDA((int)strokes[i].x, (int)strokes[i].y, (int)strokes[i + 1].x, (int)strokes[i + 1].y, Color::WHITE);
+	});
+	double batch = bestOf(10, [&]() { image.DrawLines(&strokes[0], strokes.size(), Color::WHITE); });
+	report("strokes", legacy, clipped);
+	std::cout << "strokes with DrawLines: " << num_lines / batch * 0.001 << " M lines/s (x" << legacy / batch << ")" << std::endl;
+
+	legacy = bestOf(10, [&]() {
+		for (int i = 0; i < num_lines; ++i)
+			drawLineDDALegacy(image, (int)ends[i * 2].x, (int)ends[i * 2].y, (int)ends[i * 2 + 1].x, (int)ends[i * 2 + 1].y, Color::WHITE);
+	});
+	clipped = bestOf(10, [&]() {
+		for (int i = 0; i < num_lines; ++i)
+			image.DrawLineDDA((int)ends[i * 2].x, (int)ends[i * 2].y, (int)ends[i * 2 + 1].x, (int)ends[i * 2 + 1].y, Color::WHITE);
+	});
+	report("long lines, mostly outside", legacy, clipped);
+}
+
+// ***** Polygons *****
+
+// Scanline fill without edge table: every edge is tested on every scanline and the crossings are sorted from scratch
+static void fillPolygonPerScanline(Image& image, const Vector2* points, size_t count, const Color& c, FillRule rule)
+{
+	std::vector<std::pair<float, int>> crossings;
+	for (int y = 0; y < (int)image.height; ++y)
+	{
+		const float center = y + 0.5f;
+		crossings.clear();
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Vector2& a = points[i];
+			const Vector2& b = points[(i + 1) % count];
+			const Vector2& top = a.y < b.y ? a : b;
+			const Vector2& bottom = a.y < b.y ? b : a;
+			if (center >= top.y && center < bottom.y)
+				crossings.push_back(std::make_pair(top.x + (center - top.y) * ((bottom.x - top.x) / (bottom.y - top.y)), a.y < b.y ? 1 : -1));
+		}
+		std::sort(crossings.begin(), crossings.end());
+
+		int winding = 0;
+		for (size_t i = 0; i + 1 < crossings.size(); ++i)
+		{
+			winding += rule == FILL_EVEN_ODD ? 1 : crossings[i].second;
+			if (rule == FILL_EVEN_ODD ? (winding & 1) == 0 : winding == 0)
+				continue;
+			for (int x = (int)std::ceil(crossings[i].first - 0.5f); x < (int)std::ceil(crossings[i + 1].first - 0.5f); ++x)
+				if (x >= 0 && x < (int)image.width)
+					image.SetPixelUnsafe(x, y, c);
+		}
+	}
+}
+
+static void benchmarkPolygons()
+{
+	std::cout << "*** FillPolygon on a 1920x1080 image (best of 10 runs)" << std::endl;
+
+	// A star like an imported outline (no crossings) and a scribble like a lasso (crosses itself all the time)
+	const int num_points = 4000;
+	std::vector<Vector2> star(num_points), scribble(num_points);
+	for (int i = 0; i < num_points; ++i)
+	{
+		float angle = i * 2.0f * PI / num_points;
+		float radius = (i % 2 ? 500.0f : 300.0f) + randomValue() * 40.0f;
+		star[i].set(960.0f + cosf(angle) * radius, 540.0f + sinf(angle) * radius);
+		scribble[i].set(200.0f + randomValue() * 1520.0f, 100.0f + randomValue() * 880.0f);
+	}
+
+	const char* rules[] = { "even-odd", "non-zero" };
+	Image expected(1920, 1080), image(1920, 1080);
+	for (int rule = FILL_EVEN_ODD; rule <= FILL_NON_ZERO; ++rule)
+	{
+		for (int shape = 0; shape < 2; ++shape)
+		{
+			const std::vector<Vector2>& points = shape ? scribble : star;
+			expected.Fill(Color::BLACK);
+			image.Fill(Color::BLACK);
+			double reference = bestOf(10, [&]() { fillPolygonPerScanline(expected, &points[0], points.size(), Color::WHITE, (FillRule)rule); });
+			double table = bestOf(10, [&]() { image.FillPolygon(&points[0], points.size(), Color::WHITE, (FillRule)rule); });
+			bool same = memcmp(expected.pixels, image.pixels, image.width * image.height * sizeof(Color)) == 0;
+			std::cout << (shape ? "scribble" : "star") << " of " << num_points << " points, " << rules[rule] << ": every edge per scanline " << reference
+				<< " ms, edge table " << table << " ms (x" << reference / table << ")" << (same ? "" : " MISMATCH") << std::endl;
+		}
+	}
+}
+
+// ***** Flood fill *****
+
+// Pixel by pixel with an explicit stack of the 4 neighbours (a recursive one would overflow the call stack)
+static void floodFillPerPixel(Image& image, int x, int y, const Color& c)
+{
+	const Color seed = image.GetPixel(x, y);
+	auto matches = [&](int px, int py) {
+		Color p = image.GetPixel(px, py);
+		return p.r == seed.r && p.g == seed.g && p.b == seed.b;
+	};
+	std::vector<std::pair<int, int>> stack(1, std::make_pair(x, y));
+	while (!stack.empty())
+	{
+		std::pair<int, int> p = stack.back();
+		stack.pop_back();
+		if (p.first < 0 || p.first >= (int)image.width || p.second < 0 || p.second >= (int)image.height || !matches(p.first, p.second))
+			continue;
+		image.SetPixelUnsafe(p.first, p.second, c);
+		stack.push_back(std::make_pair(p.first - 1, p.second));
+		stack.push_back(std::make_pair(p.first + 1, p.second));
+		stack.push_back(std::make_pair(p.first, p.second - 1));
+		stack.push_back(std::make_pair(p.first, p.second + 1));
+	}
+}
+
+static void benchmarkFloodFill()
+{
+	std::cout << "*** FloodFill on a 1920x1080 image (best of 10 runs)" << std::endl;
+
+	// An empty canvas, walls with a gap at alternating ends (one long corridor) and random dots
+	Image empty(1920, 1080), corridor(1920, 1080), dots(1920, 1080);
+	for (unsigned int y = 0; y < 1080; ++y)
+		for (unsigned int x = 0; x < 1920; ++x)
+		{
+			if (x % 4 == 2 && y != (x / 4 % 2 ? 0u : 1079u))
+				corridor.SetPixelUnsafe(x, y, Color::WHITE);
+			if (randomValue() < 0.2f)
+				dots.SetPixelUnsafe(x, y, Color::WHITE);
+		}
+	dots.SetPixelUnsafe(0, 0, Color::BLACK);
+
+	const char* names[] = { "empty", "corridor", "20% dots" };
+	const Image* sources[] = { &empty, &corridor, &dots };
+	for (int i = 0; i < 3; ++i)
+	{
+		Image expected, result;
+		double reference = bestOf(10, [&]() { expected = *sources[i]; floodFillPerPixel(expected, 0, 0, Color::RED); });
+		double spans = bestOf(10, [&]() { result = *sources[i]; result.FloodFill(0, 0, Color::RED); });
+		bool same = memcmp(expected.pixels, result.pixels, result.width * result.height * sizeof(Color)) == 0;
+		std::cout << names[i] << ": per pixel " << reference << " ms, spans " << spans << " ms (x" << reference / spans << ", both with a copy of the image)"
+			<< (same ? "" : " MISMATCH") << std::endl;
+	}
+}
+
+struct Benchmark
+{
+	const char* name;
+	void (*callback)();
+};
+
+static const Benchmark s_benchmarks[] = {
+	{ "obj", benchmarkOBJ },
+	{ "mesh", benchmarkMeshCache },
+	{ "blit", benchmarkBlit },
+	{ "math", benchmarkMath },
+	{ "pixels", benchmarkForEachPixel },
+	{ "png", benchmarkPNG },
+	{ "lines", benchmarkLines },
+	{ "polygons", benchmarkPolygons },
+	{ "flood", benchmarkFloodFill },
+};
+
+bool runBenchmark(const char* name)
+{
+	bool found = false;
+	for (const Benchmark& benchmark : s_benchmarks)
+	{
+		if (strcmp(name, "all") != 0 && strcmp(name, benchmark.name) != 0)
+			continue;
+		benchmark.callback();
+		found = true;
+	}
+
+	if (!found)
+	{
+		std::cerr << "Unknown benchmark: " << name << ". Available:";
+		for (const Benchmark& benchmark : s_benchmarks)
+			std::cerr << " " << benchmark.name;
+		std::cerr << std::endl;
+	}
+	return found;
+}
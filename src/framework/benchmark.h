@@ -0,0 +1,9 @@
+/*
+	+ Benchmarks of the hot paths of the framework. They do not need a window or an OpenGL context.
+	+ Run them from the command line with: ComputerGraphics --bench [name]
+*/
+
+#pragma once
+
+// Runs the benchmark with the given name ("all" runs every one), returns false if it does not exist
+bool runBenchmark(const char* name);
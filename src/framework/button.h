@@ -1,6 +1,5 @@
 #pragma once
-#include "image.h"
-#include "framework.h" // Vector2
+#include "framework.h" // Vector2, Rect
 
 enum ButtonType {
     BTN_PENCIL,
@@ -26,12 +25,12 @@ enum ButtonType {
 
 class Button {
 public:
-    Image icon;
+    Rect icon; // Area of the icon in the toolbar atlas of the application
     Vector2 pos;
     ButtonType type;
 
-    int w() const { return (int)icon.width; }
-    int h() const { return (int)icon.height; }
+    int w() const { return icon.width; }
+    int h() const { return icon.height; }
 
     bool IsMouseInside(Vector2 m) const
     {
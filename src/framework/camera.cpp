@@ -6,20 +6,20 @@
 Camera::Camera()
 {
 	view_matrix.SetIdentity();
+	inverse_view_matrix.SetIdentity();
+	view_dirty = false;
 	SetOrthographic(-1,1,1,-1,-1,1);
+	UpdateMatrices();
 }
 
 Vector3 Camera::GetLocalVector(const Vector3& v)
 {
-	Matrix44 iV = view_matrix;
-	if (iV.Inverse() == false)
-		std::cout << "Matrix Inverse error" << std::endl;
-	Vector3 result = iV.RotateVector(v);
-	return result;
+	return GetInverseViewMatrix().RotateVector(v);
 }
 
 Vector3 Camera::ProjectVector(Vector3 pos)
 {
+	UpdateMatrices();
 	Vector4 pos4 = Vector4(pos.x, pos.y, pos.z, 1.0);
 	Vector4 result = viewprojection_matrix * pos4;
 	if (type == ORTHOGRAPHIC)
@@ -34,7 +34,7 @@ void Camera::Rotate(float angle, const Vector3& axis)
 	R.MakeRotationMatrix(angle, axis);
 	Vector3 new_front = R * (center - eye);
 	center = eye + new_front;
-	UpdateViewMatrix();
+	view_dirty = true;
 }
 
 void Camera::Move(Vector3 delta)
@@ -42,7 +42,7 @@ void Camera::Move(Vector3 delta)
 	Vector3 localDelta = GetLocalVector(delta);
 	eye = eye - localDelta;
 	center = center - localDelta;
-	UpdateViewMatrix();
+	view_dirty = true;
 }
 
 void Camera::SetOrthographic(float left, float right, float top, float bottom, float near_plane, float far_plane)
@@ -56,7 +56,7 @@ void Camera::SetOrthographic(float left, float right, float top, float bottom, f
 	this->near_plane = near_plane;
 	this->far_plane = far_plane;
 
-	UpdateProjectionMatrix();
+	projection_dirty = true;
 }
 
 void Camera::SetPerspective(float fov, float aspect, float near_plane, float far_plane)
@@ -68,7 +68,7 @@ void Camera::SetPerspective(float fov, float aspect, float near_plane, float far
 	this->near_plane = near_plane;
 	this->far_plane = far_plane;
 
-	UpdateProjectionMatrix();
+	projection_dirty = true;
 }
 
 void Camera::LookAt(const Vector3& eye, const Vector3& center, const Vector3& up)
@@ -77,50 +77,84 @@ void Camera::LookAt(const Vector3& eye, const Vector3& center, const Vector3& up
 	this->center = center;
 	this->up = up;
 
-	UpdateViewMatrix();
+	view_dirty = true;
 }
 
 void Camera::UpdateViewMatrix()
+{
+	view_dirty = true;
+	UpdateMatrices();
+}
+
+void Camera::UpdateProjectionMatrix()
+{
+	projection_dirty = true;
+	UpdateMatrices();
+}
+
+void Camera::BuildViewMatrix()
 {
 	// Reset Matrix (Identity)
 	view_matrix.SetIdentity();
 
-	// Comment this line to create your own projection matrix!
-	SetExampleViewMatrix();
+	// Computed in the CPU (same result as gluLookAt) so no GL context is needed
+	// SetExampleViewMatrix();
 
-	// Remember how to fill a Matrix4x4 (check framework slides)
-	// Careful with the order of matrix multiplications, and be sure to use normalized vectors!
-	
-	// Create the view matrix rotation
-	// ...
-	// view_matrix.M[3][3] = 1.0;
+	// Create the view matrix rotation, the rows are the axis of the camera
+	Vector3 front = center - eye;
+	front.Normalize();
+	Vector3 side = front.Cross(up);
+	side.Normalize();
+	Vector3 top = side.Cross(front);
 
-	// Translate view matrix
-	// ...
+	view_matrix.M[0][0] = side.x;	view_matrix.M[1][0] = side.y;	view_matrix.M[2][0] = side.z;
+	view_matrix.M[0][1] = top.x;	view_matrix.M[1][1] = top.y;	view_matrix.M[2][1] = top.z;
+	view_matrix.M[0][2] = -front.x;	view_matrix.M[1][2] = -front.y;	view_matrix.M[2][2] = -front.z;
+	view_matrix.M[3][3] = 1.0;
 
-	UpdateViewProjectionMatrix();
+	// Translate view matrix
+	view_matrix.M[3][0] = -side.Dot(eye);
+	view_matrix.M[3][1] = -top.Dot(eye);
+	view_matrix.M[3][2] = front.Dot(eye);
+
+	// Rigid body inverse: the transposed rotation (the axis as columns) and the eye as translation
+	inverse_view_matrix.SetIdentity();
+	inverse_view_matrix.M[0][0] = side.x;	inverse_view_matrix.M[0][1] = side.y;	inverse_view_matrix.M[0][2] = side.z;
+	inverse_view_matrix.M[1][0] = top.x;	inverse_view_matrix.M[1][1] = top.y;	inverse_view_matrix.M[1][2] = top.z;
+	inverse_view_matrix.M[2][0] = -front.x;	inverse_view_matrix.M[2][1] = -front.y;	inverse_view_matrix.M[2][2] = -front.z;
+	inverse_view_matrix.M[3][0] = eye.x;	inverse_view_matrix.M[3][1] = eye.y;	inverse_view_matrix.M[3][2] = eye.z;
+
+	view_dirty = false;
 }
 
 // Create a projection matrix
-void Camera::UpdateProjectionMatrix()
+void Camera::BuildProjectionMatrix()
 {
 	// Reset Matrix (Identity)
 	projection_matrix.SetIdentity();
 
-	// Comment this line to create your own projection matrix!
-	SetExampleProjectionMatrix();
+	// Computed in the CPU (same result as gluPerspective/glOrtho) so no GL context is needed
+	// SetExampleProjectionMatrix();
 
-	// Remember how to fill a Matrix4x4 (check framework slides)
-	
 	if (type == PERSPECTIVE) {
-		// projection_matrix.M[2][3] = -1;
-		// ...
+		float f = 1.0f / tanf(fov * DEG2RAD * 0.5f);
+		projection_matrix.M[0][0] = f / aspect;
+		projection_matrix.M[1][1] = f;
+		projection_matrix.M[2][2] = (far_plane + near_plane) / (near_plane - far_plane);
+		projection_matrix.M[2][3] = -1;
+		projection_matrix.M[3][2] = 2.0f * far_plane * near_plane / (near_plane - far_plane);
+		projection_matrix.M[3][3] = 0;
 	}
 	else if (type == ORTHOGRAPHIC) {
-		// ...
+		projection_matrix.M[0][0] = 2.0f / (right - left);
+		projection_matrix.M[1][1] = 2.0f / (top - bottom);
+		projection_matrix.M[2][2] = -2.0f / (far_plane - near_plane);
+		projection_matrix.M[3][0] = -(right + left) / (right - left);
+		projection_matrix.M[3][1] = -(top + bottom) / (top - bottom);
+		projection_matrix.M[3][2] = -(far_plane + near_plane) / (far_plane - near_plane);
 	} 
 
-	UpdateViewProjectionMatrix();
+	projection_dirty = false;
 }
 
 void Camera::UpdateViewProjectionMatrix()
@@ -128,12 +162,16 @@ void Camera::UpdateViewProjectionMatrix()
 	viewprojection_matrix = projection_matrix * view_matrix;
 }
 
-Matrix44 Camera::GetViewProjectionMatrix()
+void Camera::UpdateMatrices()
 {
-	UpdateViewMatrix();
-	UpdateProjectionMatrix();
+	if (!view_dirty && !projection_dirty)
+		return;
 
-	return viewprojection_matrix;
+	if (view_dirty)
+		BuildViewMatrix();
+	if (projection_dirty)
+		BuildProjectionMatrix();
+	UpdateViewProjectionMatrix();
 }
 
 // The following methods have been created for testing.
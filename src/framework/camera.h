@@ -2,6 +2,8 @@
 	This class wraps the behaviour of a camera. A Camera helps to set the point of view from where we will render the scene.
 	The most important attributes are  eye and center which say where is the camera and where is it pointing.
 	This class also stores the matrices used to do the transformation and projection of the scene.
+	The matrices are rebuilt only when something changed: the setters mark them as dirty and the getters update them.
+	If eye/center/up or the projection properties are modified directly call UpdateViewMatrix/UpdateProjectionMatrix.
 */
 #pragma once
 
@@ -14,6 +16,16 @@ class Camera
 	void SetExampleViewMatrix();
 	void SetExampleProjectionMatrix();
 
+	// The matrices need to be rebuilt
+	bool view_dirty;
+	bool projection_dirty;
+
+	void BuildViewMatrix();
+	void BuildProjectionMatrix();
+
+	// Camera to world (the view matrix is a rotation and a translation so it is built directly, not inverted)
+	Matrix44 inverse_view_matrix;
+
 public:
 
 	// Types of cameras available
@@ -42,7 +54,7 @@ public:
 	Camera();
 
 	// Setters
-	void SetAspectRatio(float aspect) { this->aspect = aspect; };
+	void SetAspectRatio(float aspect) { this->aspect = aspect; projection_dirty = true; };
 
 	// Translate and rotate the camera
 	void Move(Vector3 delta);
@@ -59,10 +71,16 @@ public:
 	void SetOrthographic(float left, float right, float top, float bottom, float near_plane, float far_plane);
 	void LookAt(const Vector3& eye, const Vector3& center, const Vector3& up);
 
-	// Compute the matrices
+	// Compute the matrices now (and the other one if it is dirty)
 	void UpdateViewMatrix();
 	void UpdateProjectionMatrix();
 	void UpdateViewProjectionMatrix();
 
-	Matrix44 GetViewProjectionMatrix();
+	// Rebuild only the dirty matrices
+	void UpdateMatrices();
+
+	const Matrix44& GetViewMatrix() { UpdateMatrices(); return view_matrix; }
+	const Matrix44& GetProjectionMatrix() { UpdateMatrices(); return projection_matrix; }
+	const Matrix44& GetViewProjectionMatrix() { UpdateMatrices(); return viewprojection_matrix; }
+	const Matrix44& GetInverseViewMatrix() { UpdateMatrices(); return inverse_view_matrix; }
 };
\ No newline at end of file
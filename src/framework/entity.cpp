@@ -0,0 +1,188 @@
+#include "entity.h"
+#include "mesh.h"
+#include "camera.h"
+#include "utils.h"
+
+// Vertices processed by every task of the vertex stage
+#define VERTEX_BATCH_SIZE 4096
+
+// Vertex after the vertex stage, used while clipping
+struct ClipVertex
+{
+	Vector4 pos;
+	float r, g, b;
+};
+
+// Lambert lighting with a directional light (the normals are rotated by the model matrix)
+static void shadeVertices(const Matrix44& model, const Vector3* normals, const Vector3& light_dir, const Color& color, Color* out, unsigned int n)
+{
+	const float* m = model.m;
+	for (unsigned int i = 0; i < n; ++i)
+	{
+		const Vector3& nl = normals[i];
+		Vector3 nw(m[0] * nl.x + m[4] * nl.y + m[8] * nl.z,
+			m[1] * nl.x + m[5] * nl.y + m[9] * nl.z,
+			m[2] * nl.x + m[6] * nl.y + m[10] * nl.z);
+		float len = nw.Length();
+		float NdotL = len > 0.0f ? nw.Dot(light_dir) / len : 0.0f;
+		float intensity = 0.2f + 0.8f * std::max(NdotL, 0.0f);
+		out[i] = Color(color.r * intensity, color.g * intensity, color.b * intensity);
+	}
+}
+
+// Frustum planes crossed by a clip space position (one bit per plane)
+static inline int computeOutcode(const Vector4& p)
+{
+	int code = 0;
+	if (p.x < -p.w) code |= 1;
+	if (p.x > p.w) code |= 2;
+	if (p.y < -p.w) code |= 4;
+	if (p.y > p.w) code |= 8;
+	if (p.z < -p.w) code |= 16; // Near plane
+	if (p.z > p.w) code |= 32;
+	return code;
+}
+
+static ClipVertex lerpVertex(const ClipVertex& a, const ClipVertex& b, float t)
+{
+	ClipVertex v;
+	v.pos.Set(a.pos.x + (b.pos.x - a.pos.x) * t, a.pos.y + (b.pos.y - a.pos.y) * t,
+		a.pos.z + (b.pos.z - a.pos.z) * t, a.pos.w + (b.pos.w - a.pos.w) * t);
+	v.r = a.r + (b.r - a.r) * t;
+	v.g = a.g + (b.g - a.g) * t;
+	v.b = a.b + (b.b - a.b) * t;
+	return v;
+}
+
+// Clips a triangle against the near plane (z >= -w), returns the number of vertices of the resulting polygon
+static int clipNearPlane(const ClipVertex* in, ClipVertex* out)
+{
+	int count = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		const ClipVertex& a = in[i];
+		const ClipVertex& b = in[(i + 1) % 3];
+		float da = a.pos.z + a.pos.w;
+		float db = b.pos.z + b.pos.w;
+
+		if (da >= 0.0f)
+			out[count++] = a;
+		if ((da >= 0.0f) != (db >= 0.0f))
+			out[count++] = lerpVertex(a, b, da / (da - db));
+	}
+	return count;
+}
+
+Entity::Entity()
+{
+	mesh = NULL;
+	color = Color::WHITE;
+	cull_backfaces = true;
+}
+
+Entity::Entity(Mesh* mesh) : Entity()
+{
+	this->mesh = mesh;
+}
+
+void Entity::Render(Image* framebuffer, Camera* camera, FloatImage* zbuffer)
+{
+	if (!mesh || !framebuffer || !camera)
+		return;
+
+	const std::vector<Vector3>& vertices = mesh->GetVertices();
+	const std::vector<Vector3>& normals = mesh->GetNormals();
+	const std::vector<unsigned int>& indices = mesh->GetIndices();
+	const unsigned int num_vertices = (unsigned int)vertices.size();
+	const unsigned int num_triangles = mesh->GetTriangleCount();
+	if (num_triangles == 0)
+		return;
+
+	// 1) VERTEX STAGE: every batch of the vertex array is transformed and lit in parallel
+	// Indexed meshes only process each unique vertex once
+	Matrix44 mvp = camera->GetViewProjectionMatrix() * model;
+	Vector3 light_dir = camera->eye - camera->center;
+	light_dir.Normalize();
+	bool has_normals = normals.size() == num_vertices;
+
+	clip_positions.resize(num_vertices);
+	vertex_colors.resize(num_vertices);
+
+	int num_batches = (num_vertices + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE;
+	parallelFor(num_batches, [&](int batch) {
+		unsigned int start = batch * VERTEX_BATCH_SIZE;
+		unsigned int count = std::min(num_vertices - start, (unsigned int)VERTEX_BATCH_SIZE);
+		mvp.TransformPoints(&vertices[start], &clip_positions[start], count);
+		if (has_normals)
+			shadeVertices(model, &normals[start], light_dir, color, &vertex_colors[start], count);
+		else
+			std::fill(vertex_colors.begin() + start, vertex_colors.begin() + start + count, color);
+	});
+
+	// 2) PRIMITIVE STAGE: clip, project to the viewport and send the triangles to the rasterizer
+	const float half_w = framebuffer->width * 0.5f;
+	const float half_h = framebuffer->height * 0.5f;
+	rasterizer.Begin(framebuffer->width, framebuffer->height);
+
+	const bool indexed = mesh->IsIndexed();
+	for (unsigned int t = 0; t < num_triangles; ++t)
+	{
+		unsigned int corners[3] = { t * 3, t * 3 + 1, t * 3 + 2 };
+		if (indexed)
+		{
+			corners[0] = indices[corners[0]];
+			corners[1] = indices[corners[1]];
+			corners[2] = indices[corners[2]];
+		}
+
+		const Vector4 p[3] = { clip_positions[corners[0]], clip_positions[corners[1]], clip_positions[corners[2]] };
+		int oc0 = computeOutcode(p[0]), oc1 = computeOutcode(p[1]), oc2 = computeOutcode(p[2]);
+
+		// All the vertices outside the same plane
+		if (oc0 & oc1 & oc2)
+			continue;
+
+		ClipVertex polygon[4];
+		int count = 3;
+		for (int k = 0; k < 3; ++k)
+		{
+			const Color& c = vertex_colors[corners[k]];
+			polygon[k].pos = p[k];
+			polygon[k].r = c.r; polygon[k].g = c.g; polygon[k].b = c.b;
+		}
+
+		// Only the near plane needs real clipping, the rest is done by the rasterizer bounding box
+		if ((oc0 | oc1 | oc2) & 16)
+		{
+			ClipVertex input[3] = { polygon[0], polygon[1], polygon[2] };
+			count = clipNearPlane(input, polygon);
+			if (count < 3)
+				continue;
+		}
+
+		// Perspective divide and viewport transform
+		Vector3 screen[4];
+		Color colors[4];
+		for (int k = 0; k < count; ++k)
+		{
+			const Vector4& cp = polygon[k].pos;
+			float inv_w = 1.0f / cp.w;
+			screen[k].Set((cp.x * inv_w + 1.0f) * half_w, (cp.y * inv_w + 1.0f) * half_h, cp.z * inv_w);
+			colors[k].Set(polygon[k].r, polygon[k].g, polygon[k].b);
+		}
+
+		// Counter clockwise triangles are the front faces
+		if (cull_backfaces)
+		{
+			float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+			if (area <= 0.0f)
+				continue;
+		}
+
+		for (int k = 1; k + 1 < count; ++k)
+			rasterizer.AddTriangle(screen[0], screen[k], screen[k + 1], colors[0], colors[k], colors[k + 1]);
+	}
+
+	// 3) RASTER STAGE: depth tested fill, the screen tiles run in parallel
+	rasterizer.Flush(*framebuffer, zbuffer);
+}
@@ -0,0 +1,39 @@
+/*
+	+ An Entity is a Mesh placed in the world through its model matrix.
+	+ It can be rendered into a CPU framebuffer with the software pipeline:
+	  vertex transform (in batches), clipping, viewport mapping and depth tested triangle fill.
+*/
+
+#pragma once
+
+#include <vector>
+#include "framework.h"
+#include "image.h"
+#include "rasterizer.h"
+
+class Mesh;
+class Camera;
+
+class Entity
+{
+public:
+	Mesh* mesh;
+	Matrix44 model;
+
+	Color color;			// Base color, lit with a directional light when the mesh has normals
+	bool cull_backfaces;	// Skip the triangles facing away from the camera
+
+	Entity();
+	Entity(Mesh* mesh);
+
+	// Renders the mesh into the framebuffer
+	// The zbuffer must have the size of the framebuffer and be cleared with a big value (ex: FLT_MAX) every frame
+	void Render(Image* framebuffer, Camera* camera, FloatImage* zbuffer);
+
+private:
+	// Results of the vertex stage, kept between frames to avoid allocations
+	std::vector<Vector4> clip_positions;
+	std::vector<Color> vertex_colors;
+
+	TileRasterizer rasterizer;
+};
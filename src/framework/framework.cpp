@@ -307,75 +307,6 @@ bool Matrix44::GetXYZ(float* euler) const
 	return false;
 }
 
-//Multiply a matrix by another and returns the result
-Matrix44 Matrix44::operator*(const Matrix44& matrix) const
-{
-	Matrix44 ret;
-
-	unsigned int i,j,k;
-	for (i=0;i<4;i++)
-	{
-		for (j=0;j<4;j++)
-		{
-			ret.M[i][j]=0.0;
-			for (k=0;k<4;k++) 
-				ret.M[i][j] += M[k][j] * matrix.M[i][k];
-		}
-	}
-
-	return ret;
-}
-
-//it allows to add two vectors
-Vector3 operator + (const Vector3& a, const Vector3& b) 
-{
-	return Vector3(a.x + b.x, a.y + b.y, a.z + b.z );
-}
-
-//it allows to add two vectors
-Vector3 operator - (const Vector3& a, const Vector3& b) 
-{
-	return Vector3(a.x - b.x, a.y - b.y, a.z - b.z );
-}
-
-Vector3 operator * (const Vector3& a, float v) 
-{
-	return Vector3(a.x * v, a.y * v, a.z * v);
-}
-
-Vector3 operator / (const Vector3& a, float v)
-{
-	return Vector3(a.x / v, a.y / v, a.z / v);
-}
-
-Vector3 operator * (const Vector3& a, const Vector3& b)
-{
-	return Vector3(a.x * b.x, a.y * b.y, a.z * b.z);
-}
-
-Vector3 operator / (const Vector3& a, const Vector3& b)
-{
-	return Vector3(a.x / b.x, a.y / b.y, a.z / b.z);
-}
-
-Vector4 operator * (const Matrix44& matrix, const Vector4& v)
-{
-	float x = matrix.m[0] * v.x + matrix.m[4] * v.y + matrix.m[8] * v.z + matrix.m[12] * v.w;
-	float y = matrix.m[1] * v.x + matrix.m[5] * v.y + matrix.m[9] * v.z + matrix.m[13] * v.w;
-	float z = matrix.m[2] * v.x + matrix.m[6] * v.y + matrix.m[10] * v.z + matrix.m[14] * v.w;
-	float w = matrix.m[3] * v.x + matrix.m[7] * v.y + matrix.m[11] * v.z + matrix.m[15] * v.w;
-	return Vector4(x, y, z, w);
-}
-
-//Multiplies a vector by a matrix and returns the new vector ( assumes v4 = (v.x, v.y, v.z, 1) )
-Vector3 operator * (const Matrix44& matrix, const Vector3& v)
-{   
-   float x = matrix.m[0] * v.x + matrix.m[4] * v.y + matrix.m[8] * v.z + matrix.m[12]; 
-   float y = matrix.m[1] * v.x + matrix.m[5] * v.y + matrix.m[9] * v.z + matrix.m[13]; 
-   float z = matrix.m[2] * v.x + matrix.m[6] * v.y + matrix.m[10] * v.z + matrix.m[14];
-   return Vector3(x,y,z);
-}
-
 void Matrix44::SetUpAndOrthonormalize(Vector3 up)
 {
 	up.Normalize();
@@ -448,6 +379,128 @@ void Matrix44::SetFrontAndOrthonormalize(Vector3 front)
 	
 }
 
+void Matrix44::TransformPoints(const Vector3* in, Vector4* out, size_t n) const
+{
+	size_t i = 0;
+#ifdef FRAMEWORK_SSE
+	const __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]), m3 = _mm_set1_ps(m[3]);
+	const __m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6 = _mm_set1_ps(m[6]), m7 = _mm_set1_ps(m[7]);
+	const __m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]), m11 = _mm_set1_ps(m[11]);
+	const __m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]), m15 = _mm_set1_ps(m[15]);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		// 4 points (12 floats) to x/y/z lanes
+		const float* p = &in[i].x;
+		__m128 a = _mm_loadu_ps(p);		// x0 y0 z0 x1
+		__m128 b = _mm_loadu_ps(p + 4);	// y1 z1 x2 y2
+		__m128 c = _mm_loadu_ps(p + 8);	// z2 x3 y3 z3
+		__m128 t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2));	// x2 y2 z2 x3
+		__m128 u = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));	// y0 z0 y1 z1
+		__m128 v = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));	// y2 y2 y3 y3
+		__m128 x = _mm_shuffle_ps(a, t, _MM_SHUFFLE(3, 0, 3, 0));
+		__m128 y = _mm_shuffle_ps(u, v, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 z = _mm_shuffle_ps(u, c, _MM_SHUFFLE(3, 0, 3, 1));
+
+		__m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_add_ps(_mm_mul_ps(m8, z), m12));
+		__m128 oy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_add_ps(_mm_mul_ps(m9, z), m13));
+		__m128 oz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_add_ps(_mm_mul_ps(m10, z), m14));
+		__m128 ow = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, x), _mm_mul_ps(m7, y)), _mm_add_ps(_mm_mul_ps(m11, z), m15));
+
+		// Back to one Vector4 per point
+		_MM_TRANSPOSE4_PS(ox, oy, oz, ow);
+		_mm_storeu_ps(out[i].v, ox);
+		_mm_storeu_ps(out[i + 1].v, oy);
+		_mm_storeu_ps(out[i + 2].v, oz);
+		_mm_storeu_ps(out[i + 3].v, ow);
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		const float x = in[i].x, y = in[i].y, z = in[i].z;
+		out[i].x = m[0] * x + m[4] * y + m[8] * z + m[12];
+		out[i].y = m[1] * x + m[5] * y + m[9] * z + m[13];
+		out[i].z = m[2] * x + m[6] * y + m[10] * z + m[14];
+		out[i].w = m[3] * x + m[7] * y + m[11] * z + m[15];
+	}
+}
+
+#ifdef FRAMEWORK_SSE
+
+// 2x2 matrices packed in a register as (a b c d) = | a b |
+//                                                  | c d |
+#define SWIZZLE(v, x, y, z, w) _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+
+// A * B
+static inline __m128 mat2Mul(__m128 a, __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)), _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// adj(A) * B
+static inline __m128 mat2AdjMul(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b), _mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// A * adj(B)
+static inline __m128 mat2MulAdj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)), _mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// Inverse by 2x2 blocks | A B |, the inverse of the transpose is the transpose of the inverse
+//                       | C D |  so it works the same with the column-major storage
+bool Matrix44::Inverse()
+{
+	const __m128 r0 = _mm_loadu_ps(m), r1 = _mm_loadu_ps(m + 4), r2 = _mm_loadu_ps(m + 8), r3 = _mm_loadu_ps(m + 12);
+	const __m128 A = _mm_movelh_ps(r0, r1), B = _mm_movehl_ps(r1, r0);
+	const __m128 C = _mm_movelh_ps(r2, r3), D = _mm_movehl_ps(r3, r2);
+
+	// Determinants of the blocks (|A| |B| |C| |D|)
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+	__m128 det_A = SWIZZLE(det_sub, 0, 0, 0, 0);
+	__m128 det_B = SWIZZLE(det_sub, 1, 1, 1, 1);
+	__m128 det_C = SWIZZLE(det_sub, 2, 2, 2, 2);
+	__m128 det_D = SWIZZLE(det_sub, 3, 3, 3, 3);
+
+	__m128 D_C = mat2AdjMul(D, C);
+	__m128 A_B = mat2AdjMul(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(det_D, A), mat2Mul(B, D_C));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(det_A, D), mat2Mul(C, A_B));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(det_B, C), mat2MulAdj(D, A_B));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(det_C, B), mat2MulAdj(A, D_C));
+
+	// |M| = |A||D| + |B||C| - trace(adj(A)B adj(D)C)
+	__m128 tr = _mm_mul_ps(A_B, SWIZZLE(D_C, 0, 2, 1, 3));
+	tr = _mm_add_ps(tr, SWIZZLE(tr, 2, 3, 0, 1));
+	tr = _mm_add_ps(tr, SWIZZLE(tr, 1, 0, 3, 2));
+	__m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_A, det_D), _mm_mul_ps(det_B, det_C)), tr);
+
+	// Singular, the matrix is not modified
+	if (fabsf(_mm_cvtss_f32(det)) < 1e-30f)
+		return false;
+
+	__m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+	X = _mm_mul_ps(X, inv_det);
+	Y = _mm_mul_ps(Y, inv_det);
+	Z = _mm_mul_ps(Z, inv_det);
+	W = _mm_mul_ps(W, inv_det);
+
+	// The adjugates of the blocks back to rows
+	_mm_storeu_ps(m, _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(m + 4, _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+	_mm_storeu_ps(m + 8, _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(m + 12, _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
+	return true;
+}
+
+#undef SWIZZLE
+
+#else
+
 bool Matrix44::Inverse()
 {
 	// Guassian elimination
@@ -525,6 +578,8 @@ bool Matrix44::Inverse()
    return true;
 }
 
+#endif
+
 float ComputeSignedAngle( Vector2 a, Vector2 b)
 {
 	a.normalize();
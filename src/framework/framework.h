@@ -7,6 +7,13 @@
 #include <vector>
 #include <cmath>
 #include <random>
+#include <algorithm>
+
+// The matrix operations use SSE when the compiler targets it (every x64 build), define FRAMEWORK_NO_SIMD to use the scalar code
+#if !defined(FRAMEWORK_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+	#define FRAMEWORK_SSE
+	#include <xmmintrin.h>
+#endif
 
 #ifndef PI
 	#define PI 3.14159265359
@@ -159,6 +166,36 @@ public:
 	Vector3 GetVector3() { return Vector3(x,y,z); }
 };
 
+// Rectangle of pixels, (x,y) is the corner with the smallest coordinates
+class Rect
+{
+public:
+	int x, y;
+	int width, height;
+
+	Rect() { x = y = width = height = 0; }
+	Rect(int x, int y, int width, int height) { this->x = x; this->y = y; this->width = width; this->height = height; }
+
+	bool IsEmpty() const { return width <= 0 || height <= 0; }
+	int GetArea() const { return IsEmpty() ? 0 : width * height; }
+
+	// Smallest rectangle containing both (empty rectangles are ignored)
+	void Union(const Rect& r) {
+		if (r.IsEmpty()) return;
+		if (IsEmpty()) { *this = r; return; }
+		int x1 = std::max(x + width, r.x + r.width), y1 = std::max(y + height, r.y + r.height);
+		x = std::min(x, r.x); y = std::min(y, r.y);
+		width = x1 - x; height = y1 - y;
+	}
+
+	Rect Intersection(const Rect& r) const {
+		int x0 = std::max(x, r.x), y0 = std::max(y, r.y);
+		int x1 = std::min(x + width, r.x + r.width), y1 = std::min(y + height, r.y + r.height);
+		return x1 > x0 && y1 > y0 ? Rect(x0, y0, x1 - x0, y1 - y0) : Rect();
+	}
+	bool Intersects(const Rect& r) const { return !Intersection(r).IsEmpty(); }
+};
+
 //****************************
 
 class Matrix44
@@ -215,18 +252,73 @@ class Matrix44
 		bool GetXYZ(float* euler) const;
 
 		Matrix44 operator * (const Matrix44& matrix) const;
+
+		// Transforms n points (w = 1) into out, 4 points at a time as x/y/z/w lanes when SSE is available
+		void TransformPoints(const Vector3* in, Vector4* out, size_t n) const;
 };
 
 // Operators, they are our friends
-// Matrix44 operator * ( const Matrix44& a, const Matrix44& b );
-Vector3 operator * (const Matrix44& matrix, const Vector3& v);
-Vector3 operator + (const Vector3& a, const Vector3& b);
-Vector3 operator - (const Vector3& a, const Vector3& b);
-Vector3 operator * (const Vector3& a, float v);
-Vector3 operator / (const Vector3& a, float v);
-Vector3 operator * (const Vector3& a, const Vector3& b);
-Vector3 operator / (const Vector3& a, const Vector3& b);
-Vector4 operator * (const Matrix44& matrix, const Vector4& v);
+// Defined here so they are inlined in the vertex loops
+
+inline Vector3 operator + (const Vector3& a, const Vector3& b) { return Vector3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vector3 operator - (const Vector3& a, const Vector3& b) { return Vector3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vector3 operator * (const Vector3& a, float v) { return Vector3(a.x * v, a.y * v, a.z * v); }
+inline Vector3 operator / (const Vector3& a, float v) { return Vector3(a.x / v, a.y / v, a.z / v); }
+inline Vector3 operator * (const Vector3& a, const Vector3& b) { return Vector3(a.x * b.x, a.y * b.y, a.z * b.z); }
+inline Vector3 operator / (const Vector3& a, const Vector3& b) { return Vector3(a.x / b.x, a.y / b.y, a.z / b.z); }
+
+// Multiplies a vector by a matrix and returns the new vector ( assumes v4 = (v.x, v.y, v.z, 1) )
+inline Vector3 operator * (const Matrix44& matrix, const Vector3& v)
+{
+	const float* m = matrix.m;
+	return Vector3(m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12],
+		m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13],
+		m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14]);
+}
+
+inline Vector4 operator * (const Matrix44& matrix, const Vector4& v)
+{
+#ifdef FRAMEWORK_SSE
+	// Sum of the columns scaled by the components of the vector
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(matrix.m), _mm_set1_ps(v.x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix.m + 4), _mm_set1_ps(v.y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix.m + 8), _mm_set1_ps(v.z)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix.m + 12), _mm_set1_ps(v.w)));
+	Vector4 result;
+	_mm_storeu_ps(result.v, r);
+	return result;
+#else
+	const float* m = matrix.m;
+	return Vector4(m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12] * v.w,
+		m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13] * v.w,
+		m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] * v.w,
+		m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15] * v.w);
+#endif
+}
+
+// Multiply a matrix by another and returns the result
+inline Matrix44 Matrix44::operator * (const Matrix44& matrix) const
+{
+	Matrix44 ret;
+#ifdef FRAMEWORK_SSE
+	// Every column of the result is this matrix times a column of the other one
+	const __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+	for (int i = 0; i < 4; ++i)
+	{
+		const float* b = matrix.M[i];
+		__m128 r = _mm_mul_ps(c0, _mm_set1_ps(b[0]));
+		r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(b[1])));
+		r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(b[2])));
+		r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(b[3])));
+		_mm_storeu_ps(ret.M[i], r);
+	}
+#else
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			ret.M[i][j] = M[0][j] * matrix.M[i][0] + M[1][j] * matrix.M[i][1] + M[2][j] * matrix.M[i][2] + M[3][j] * matrix.M[i][3];
+#endif
+	return ret;
+}
 
 class Vector3u
 {
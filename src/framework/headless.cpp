@@ -0,0 +1,130 @@
+#include "headless.h"
+#include "image.h"
+#include "mesh.h"
+#include "entity.h"
+#include "camera.h"
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cfloat>
+#include <thread>
+
+struct HeadlessOptions
+{
+	std::string mesh;
+	int frames;
+	unsigned int width;
+	unsigned int height;
+	std::string out;
+	bool write;
+};
+
+static bool parseOptions(int argc, char** argv, HeadlessOptions& options)
+{
+	options.mesh = "meshes/lee.obj";
+	options.frames = 120;
+	options.width = 1280;
+	options.height = 720;
+	options.out = "frame";
+	options.write = true;
+
+	// argv[1] is --headless
+	for (int i = 2; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (strcmp(arg, "--mesh") == 0 && has_value)
+			options.mesh = argv[++i];
+		else if (strcmp(arg, "--frames") == 0 && has_value)
+			options.frames = atoi(argv[++i]);
+		else if (strcmp(arg, "--size") == 0 && has_value)
+		{
+			if (sscanf(argv[++i], "%ux%u", &options.width, &options.height) != 2)
+				options.width = options.height = 0;
+		}
+		else if (strcmp(arg, "--out") == 0 && has_value)
+			options.out = argv[++i];
+		else if (strcmp(arg, "--no-write") == 0)
+			options.write = false;
+		else if (strcmp(arg, "--threads") == 0 && has_value)
+			++i; // Already applied by main
+		else
+		{
+			std::cerr << "Headless: unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+
+	if (options.frames <= 0 || options.width == 0 || options.height == 0)
+	{
+		std::cerr << "Headless: wrong number of frames or size" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int runHeadless(int argc, char** argv)
+{
+	HeadlessOptions options;
+	if (!parseOptions(argc, argv, options))
+		return 1;
+
+	// Same scene as the animation mode of the application
+	Mesh mesh;
+	if (!mesh.LoadOBJ(options.mesh.c_str()))
+		return 1;
+	Entity entity(&mesh);
+
+	Camera camera;
+	camera.LookAt(Vector3(0.0f, 0.25f, 1.0f), Vector3(0.0f, 0.25f, 0.0f), Vector3::UP);
+	camera.SetPerspective(45.0f, options.width / (float)options.height, 0.01f, 100.0f);
+
+	// Two framebuffers: one frame is written to disk while the next one is rendered
+	Image framebuffers[2] = { Image(options.width, options.height), Image(options.width, options.height) };
+	FloatImage zbuffer(options.width, options.height);
+	std::thread writer;
+
+	std::cout << "Headless: " << options.frames << " frames of " << options.mesh << " at " << options.width << "x" << options.height << std::endl;
+
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+	double render_ms = 0.0;
+
+	for (int frame = 0; frame < options.frames; ++frame)
+	{
+		Image& framebuffer = framebuffers[frame % 2];
+
+		// One full turn
+		Clock::time_point render_start = Clock::now();
+		entity.model.MakeRotationMatrix(frame * 2.0f * PI / options.frames, Vector3::UP);
+		framebuffer.Fill(Color::BLACK);
+		zbuffer.Fill(FLT_MAX);
+		entity.Render(&framebuffer, &camera, &zbuffer);
+		render_ms += std::chrono::duration<double, std::milli>(Clock::now() - render_start).count();
+
+		if (!options.write)
+			continue;
+
+		// The writer of the previous frame has to finish before this one starts,
+		// the frame before that (the one in this framebuffer) was already joined
+		if (writer.joinable())
+			writer.join();
+
+		char filename[1024];
+		snprintf(filename, sizeof(filename), "%s_%04d.tga", options.out.c_str(), frame);
+		std::string path = filename;
+		writer = std::thread([&framebuffer, path]() { framebuffer.SaveTGA(path.c_str(), false); });
+	}
+	if (writer.joinable())
+		writer.join();
+
+	double total_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	printf("Headless: render %.2f ms/frame (%.1f fps), total %.2f ms/frame (%.1f fps)\n",
+		render_ms / options.frames, options.frames * 1000.0 / render_ms,
+		total_ms / options.frames, options.frames * 1000.0 / total_ms);
+	return 0;
+}
@@ -0,0 +1,16 @@
+/*
+	+ Headless mode: renders the 3D scene of the application into Images without a window or an OpenGL context
+	  and writes the frames to disk as fast as the CPU allows, so the render throughput can be measured.
+	+ Run it from the command line with: ComputerGraphics --headless [options]
+		--mesh file		OBJ to render, relative to the res folder (meshes/lee.obj)
+		--frames n		number of frames of the turntable (120)
+		--size WxH		size of the frames (1280x720)
+		--out prefix	frames are saved as prefix_0000.tga, relative to the working directory (frame)
+		--no-write		only render, nothing is saved
+		--threads n		threads used to render (one per CPU core)
+*/
+
+#pragma once
+
+// Returns the exit code of the program
+int runHeadless(int argc, char** argv);
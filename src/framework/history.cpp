@@ -0,0 +1,221 @@
+#include "history.h"
+#include "image.h"
+
+#include <algorithm>
+#include <cstring>
+
+// An area of the image at some point of the history, only compressed after it is made
+struct CanvasHistory::Tile
+{
+	int width, height;
+	std::vector<Color> pixels; // Empty when compressed
+	std::vector<unsigned char> runs; // Compressed: every row as runs of length (1-255) and color, a run never goes to the next row
+	size_t* memory_used;
+
+	Tile(const Image& canvas, int x, int y, int width, int height, size_t* memory_used)
+		: width(width), height(height), pixels(width * height), memory_used(memory_used)
+	{
+		for (int row = 0; row < height; ++row)
+			memcpy(&pixels[row * width], &canvas.pixels[(y + row) * canvas.width + x], width * sizeof(Color));
+		*memory_used += GetSize();
+	}
+
+	~Tile() { *memory_used -= GetSize(); }
+
+	size_t GetSize() const { return sizeof(Tile) + pixels.capacity() * sizeof(Color) + runs.capacity(); }
+
+	// Calls row(y, pixels of the row) until it returns false, the compressed rows are decoded one at a time
+	template <typename F>
+	bool ForEachRow(F row) const
+	{
+		if (!pixels.empty())
+		{
+			for (int y = 0; y < height; ++y)
+				if (!row(y, &pixels[y * width]))
+					return false;
+			return true;
+		}
+
+		Color decoded[TILE_SIZE];
+		const unsigned char* run = &runs[0];
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; run += 1 + sizeof(Color))
+			{
+				Color c;
+				memcpy(&c, run + 1, sizeof(Color));
+				std::fill(decoded + x, decoded + x + run[0], c);
+				x += run[0];
+			}
+			if (!row(y, decoded))
+				return false;
+		}
+		return true;
+	}
+
+	void CopyTo(Image& canvas, int x, int y) const
+	{
+		ForEachRow([&](int row, const Color* src) {
+			memcpy(&canvas.pixels[(y + row) * canvas.width + x], src, width * sizeof(Color));
+			return true;
+		});
+	}
+
+	bool Equals(const Image& canvas, int x, int y) const
+	{
+		return ForEachRow([&](int row, const Color* src) {
+			return memcmp(&canvas.pixels[(y + row) * canvas.width + x], src, width * sizeof(Color)) == 0;
+		});
+	}
+
+	// Kept raw if the runs would not be smaller (noise, gradients)
+	void Compress()
+	{
+		if (pixels.empty())
+			return;
+
+		std::vector<unsigned char> encoded;
+		encoded.reserve(pixels.size());
+		for (int y = 0; y < height && encoded.size() < pixels.size() * sizeof(Color); ++y)
+		{
+			const Color* row = &pixels[y * width];
+			for (int x = 0; x < width;)
+			{
+				int length = 1;
+				while (x + length < width && length < 255 && memcmp(&row[x + length], &row[x], sizeof(Color)) == 0)
+					length++;
+				encoded.push_back((unsigned char)length);
+				encoded.insert(encoded.end(), row[x].v, row[x].v + sizeof(Color));
+				x += length;
+			}
+		}
+		if (encoded.size() >= pixels.size() * sizeof(Color))
+			return;
+
+		*memory_used -= GetSize();
+		runs.assign(encoded.begin(), encoded.end());
+		std::vector<Color>().swap(pixels);
+		*memory_used += GetSize();
+	}
+};
+
+CanvasHistory::CanvasHistory(size_t budget)
+{
+	this->memory_used = 0;
+	this->budget = budget;
+	this->width = this->height = 0;
+	this->tiles_x = this->tiles_y = 0;
+	this->cursor = 0;
+}
+
+std::shared_ptr<CanvasHistory::Tile> CanvasHistory::MakeTile(const Image& canvas, int tile)
+{
+	const int x = (tile % tiles_x) * TILE_SIZE, y = (tile / tiles_x) * TILE_SIZE;
+	return std::make_shared<Tile>(canvas, x, y, std::min((int)TILE_SIZE, width - x), std::min((int)TILE_SIZE, height - y), &memory_used);
+}
+
+void CanvasHistory::Reset(const Image& canvas)
+{
+	steps.clear();
+	current.clear();
+	cursor = 0;
+	changed = Rect();
+
+	width = canvas.width;
+	height = canvas.height;
+	tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	current.resize(tiles_x * tiles_y);
+	for (int i = 0; i < tiles_x * tiles_y; ++i)
+		current[i] = MakeTile(canvas, i);
+}
+
+bool CanvasHistory::Commit(const Image& canvas)
+{
+	if ((int)canvas.width != width || (int)canvas.height != height)
+	{
+		Reset(canvas);
+		return false;
+	}
+
+	changed.Union(canvas.dirty_rect);
+	Rect area = changed.Intersection(Rect(0, 0, width, height));
+	changed = Rect();
+	if (area.IsEmpty())
+		return false;
+
+	// Only the tiles of the changed area are compared, the cost does not depend on the size of the image
+	Step step;
+	for (int ty = area.y / TILE_SIZE; ty <= (area.y + area.height - 1) / TILE_SIZE; ++ty)
+		for (int tx = area.x / TILE_SIZE; tx <= (area.x + area.width - 1) / TILE_SIZE; ++tx)
+		{
+			const int tile = ty * tiles_x + tx;
+			if (current[tile]->Equals(canvas, tx * TILE_SIZE, ty * TILE_SIZE))
+				continue;
+			Change change = { tile, current[tile], MakeTile(canvas, tile) };
+			current[tile] = change.after;
+			step.push_back(change);
+		}
+	if (step.empty())
+		return false;
+
+	// A new step forgets the ones that were undone
+	steps.erase(steps.begin() + cursor, steps.end());
+	steps.push_back(step);
+	cursor = steps.size();
+
+	// The step that stops being hot compresses the tiles it restores (the ones after it are the next steps' or the current ones)
+	if (steps.size() > (size_t)HOT_STEPS)
+		for (Change& change : steps[steps.size() - 1 - HOT_STEPS])
+			change.before->Compress();
+
+	TrimToBudget();
+	return true;
+}
+
+void CanvasHistory::Apply(const Step& step, bool undo, Image& canvas)
+{
+	for (const Change& change : step)
+	{
+		const std::shared_ptr<Tile>& tile = undo ? change.before : change.after;
+		const int x = (change.tile % tiles_x) * TILE_SIZE, y = (change.tile / tiles_x) * TILE_SIZE;
+		tile->CopyTo(canvas, x, y);
+		canvas.MarkDirty(Rect(x, y, tile->width, tile->height));
+		current[change.tile] = tile;
+	}
+}
+
+bool CanvasHistory::Undo(Image& canvas)
+{
+	if (cursor == 0 || (int)canvas.width != width || (int)canvas.height != height)
+		return false;
+	cursor--;
+	Apply(steps[cursor], true, canvas);
+	return true;
+}
+
+bool CanvasHistory::Redo(Image& canvas)
+{
+	if (cursor == steps.size() || (int)canvas.width != width || (int)canvas.height != height)
+		return false;
+	Apply(steps[cursor], false, canvas);
+	cursor++;
+	return true;
+}
+
+void CanvasHistory::SetBudget(size_t bytes)
+{
+	budget = bytes;
+	TrimToBudget();
+}
+
+void CanvasHistory::TrimToBudget()
+{
+	while (memory_used > budget && cursor > 0)
+	{
+		steps.pop_front();
+		cursor--;
+	}
+	while (memory_used > budget && cursor < steps.size())
+		steps.pop_back();
+}
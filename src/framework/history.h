@@ -0,0 +1,71 @@
+/*
+	+ CanvasHistory keeps the undo/redo steps of an image as the tiles (TILE_SIZE x TILE_SIZE) that every step changed.
+	+ Tiles are never modified once made, the steps share them: the tile after a step is the one before the next step that changes it.
+	  A step costs only the tiles it touched and undoing or redoing it only copies those back, whatever the size of the image.
+	+ The steps older than HOT_STEPS keep their tiles compressed (RLE), the oldest ones are forgotten to stay under the memory budget.
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include "framework.h"
+
+class Image;
+
+class CanvasHistory
+{
+public:
+	static const int TILE_SIZE = 64;
+	static const int HOT_STEPS = 8;
+
+	CanvasHistory(size_t budget = 256 * 1024 * 1024);
+
+	// Forgets every step, the image as it is now is the first state
+	void Reset(const Image& canvas);
+
+	// Areas of the image written since the last commit, pass the dirty rect before clearing it (Commit adds the one it has)
+	void MarkChanged(const Rect& area) { changed.Union(area); }
+
+	// Closes a step with the tiles of the changed areas that differ from the last state, returns false if none did
+	// An image of another size can not go back to the old one, it starts a new history
+	bool Commit(const Image& canvas);
+
+	// Copies back the tiles of the last step done (or undone), they are marked dirty in the image
+	bool Undo(Image& canvas);
+	bool Redo(Image& canvas);
+
+	int GetUndoCount() const { return (int)cursor; }
+	int GetRedoCount() const { return (int)(steps.size() - cursor); }
+
+	// Memory of all the tiles, the copy of the current state included
+	// The oldest steps (then the last undone ones) are dropped while it is over the budget
+	void SetBudget(size_t bytes);
+	size_t GetMemoryUsed() const { return memory_used; }
+
+private:
+	// Not copyable, the tiles count their memory in the history that made them
+	CanvasHistory(const CanvasHistory&);
+	CanvasHistory& operator = (const CanvasHistory&);
+
+	struct Tile;
+	struct Change
+	{
+		int tile;
+		std::shared_ptr<Tile> before, after;
+	};
+	typedef std::vector<Change> Step;
+
+	std::shared_ptr<Tile> MakeTile(const Image& canvas, int tile);
+	void Apply(const Step& step, bool undo, Image& canvas);
+	void TrimToBudget();
+
+	size_t memory_used;
+	size_t budget;
+	int width, height, tiles_x, tiles_y;
+	std::vector<std::shared_ptr<Tile>> current; // The tiles of the image after the last commit, undo or redo
+	std::deque<Step> steps;
+	size_t cursor; // steps[0, cursor) can be undone and steps[cursor, end) redone
+	Rect changed;
+};
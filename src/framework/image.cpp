@@ -2,23 +2,63 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <climits>
 #include "GL/glew.h"
 #include "../extra/picopng.h"
 #include "image.h"
 #include "utils.h"
 #include "camera.h"
 #include "mesh.h"
+#include "rasterizer.h"
+#include "mapped_file.h"
+#include "arena.h"
 #include <cmath> 
 #include <vector>
 
 
-struct Edge
+// One rasterizer per thread so its bins are reused between calls
+static TileRasterizer& getRasterizer(unsigned int width, unsigned int height)
 {
-	int yMax;
-	float x;
-	float invSlope;
-};
+	static thread_local TileRasterizer rasterizer;
+	rasterizer.Begin(width, height);
+	return rasterizer;
+}
 
+// Copies the area of src to dst with its corner at (x,y), clipped to both images
+// The clipping is done once for the whole rectangle and every row is moved with a single memcpy
+// Returns the area written in dst
+template <typename T>
+static Rect blitClipped(T* dst, unsigned int dst_width, unsigned int dst_height, int x, int y,
+	const T* src, unsigned int src_width, unsigned int src_height, Rect area)
+{
+	// Clip the source area to the source image, then its destination to the destination image
+	Rect src_clipped = area.Intersection(Rect(0, 0, src_width, src_height));
+	x += src_clipped.x - area.x;
+	y += src_clipped.y - area.y;
+	Rect dst_area = Rect(x, y, src_clipped.width, src_clipped.height).Intersection(Rect(0, 0, dst_width, dst_height));
+	if (dst_area.IsEmpty() || !dst || !src)
+		return Rect();
+
+	const int src_x = src_clipped.x + dst_area.x - x;
+	const int src_y = src_clipped.y + dst_area.y - y;
+	const size_t row_size = dst_area.width * sizeof(T);
+
+	if (dst != src)
+	{
+		for (int row = 0; row < dst_area.height; ++row)
+			memcpy(dst + (size_t)(dst_area.y + row) * dst_width + dst_area.x, src + (size_t)(src_y + row) * src_width + src_x, row_size);
+		return dst_area;
+	}
+
+	// Same buffer: the rows can overlap, move them in the order that never overwrites rows still to copy
+	const bool bottom_up = dst_area.y > src_y;
+	for (int i = 0; i < dst_area.height; ++i)
+	{
+		int row = bottom_up ? dst_area.height - 1 - i : i;
+		memmove(dst + (size_t)(dst_area.y + row) * dst_width + dst_area.x, src + (size_t)(src_y + row) * src_width + src_x, row_size);
+	}
+	return dst_area;
+}
 
 Image::Image() {
 	width = 0; height = 0;
@@ -31,6 +71,7 @@ Image::Image(unsigned int width, unsigned int height)
 	this->height = height;
 	pixels = new Color[width * height];
 	memset(pixels, 0, width * height * sizeof(Color));
+	MarkAllDirty();
 }
 
 // Copy constructor
@@ -45,6 +86,7 @@ Image::Image(const Image& c)
 		pixels = new Color[width * height];
 		memcpy(pixels, c.pixels, width * height * bytes_per_pixel);
 	}
+	MarkAllDirty();
 }
 
 // Assign operator
@@ -59,41 +101,128 @@ Image& Image::operator = (const Image& c)
 
 	if (c.pixels)
 	{
-		pixels = new Color[width * height * bytes_per_pixel];
+		pixels = new Color[width * height];
 		memcpy(pixels, c.pixels, width * height * bytes_per_pixel);
 	}
+	MarkAllDirty();
 	return *this;
 }
 
-// DDA 
-void Image::DrawLineDDA(int x0, int y0, int x1, int y1, const Color& c)
+void Image::Swap(Image& other)
 {
-	int dx = x1 - x0;
-	int dy = y1 - y0;
-
-	int steps;
-	if (abs(dx) > abs(dy))
-		steps = abs(dx);
-	else
-		steps = abs(dy);
+	std::swap(width, other.width);
+	std::swap(height, other.height);
+	std::swap(bytes_per_pixel, other.bytes_per_pixel);
+	std::swap(pixels, other.pixels);
+	MarkAllDirty();
+	other.MarkAllDirty();
+}
 
-	float x = (float)x0;
-	float y = (float)y0;
+// Division rounding towards minus infinity (b > 0)
+static inline long long floorDiv(long long a, long long b)
+{
+	long long q = a / b;
+	return (a % b != 0 && a < 0) ? q - 1 : q;
+}
 
-	float xInc = dx / (float)steps;
-	float yInc = dy / (float)steps;
+// Draws the pixels of the line inside the image and returns their bounding box (empty if none)
+// The line is walked along its major axis, step i is at minor0 + round(i * dminor / steps) like Bresenham.
+// The steps outside the image are clipped before the loop (Liang-Barsky), so the loop has no bounds test
+static Rect rasterLine(Color* pixels, int width, int height, int x0, int y0, int x1, int y1, const Color& c)
+{
+	if (x0 == x1 && y0 == y1)
+	{
+		if (x0 < 0 || x0 >= width || y0 < 0 || y0 >= height)
+			return Rect();
+		pixels[y0 * width + x0] = c;
+		return Rect(x0, y0, 1, 1);
+	}
 
-	for (int i = 0; i <= steps; i++)
+	const bool x_major = abs(x1 - x0) >= abs(y1 - y0);
+	const int major0 = x_major ? x0 : y0, minor0 = x_major ? y0 : x0;
+	const int dmajor = x_major ? x1 - x0 : y1 - y0, dminor = x_major ? y1 - y0 : x1 - x0;
+	const int major_size = x_major ? width : height, minor_size = x_major ? height : width;
+	const int major_step = dmajor > 0 ? 1 : -1;
+	const int steps = abs(dmajor);
+	const long long two_steps = 2LL * steps;
+
+	auto minorAt = [&](int i) { return minor0 + (int)floorDiv(2LL * i * dminor + steps, two_steps); };
+
+	// Both ends inside (the usual pencil stroke) is the whole line, otherwise it is clipped to the steps inside
+	int first = 0, last = steps;
+	const bool inside = (unsigned int)x0 < (unsigned int)width && (unsigned int)y0 < (unsigned int)height &&
+		(unsigned int)x1 < (unsigned int)width && (unsigned int)y1 < (unsigned int)height;
+	if (!inside)
 	{
-		if (x >= 0 && x < width && y >= 0 && y < height)
-			SetPixel((int)x, (int)y, c);
+		// Steps with the major coordinate inside
+		first = std::max(0, major_step > 0 ? -major0 : major0 - major_size + 1);
+		last = std::min(steps, major_step > 0 ? major_size - 1 - major0 : major0);
+
+		// Steps with the minor coordinate inside: the exact line is in [-0.5, size - 0.5) there,
+		// found with one more step on each side and then tightened with the integer rounding
+		if (dminor == 0 && (minor0 < 0 || minor0 >= minor_size))
+			return Rect();
+		if (dminor != 0)
+		{
+			double t0 = (-0.5 - minor0) * steps / dminor;
+			double t1 = (minor_size - 0.5 - minor0) * steps / dminor;
+			first = std::max(first, (int)std::max(std::ceil(std::min(t0, t1)) - 1.0, -1.0));
+			last = std::min(last, (int)std::min(std::floor(std::max(t0, t1)) + 1.0, steps + 1.0));
+		}
+		while (first <= last && (unsigned int)minorAt(first) >= (unsigned int)minor_size)
+			first++;
+		while (first <= last && (unsigned int)minorAt(last) >= (unsigned int)minor_size)
+			last--;
+		if (first > last)
+			return Rect();
+	}
 
-		x += xInc;
-		y += yInc;
+	// Bresenham from the first visible step: e is the remainder of the rounding (counted backwards when the minor axis goes down),
+	// the pixel moves on the minor axis when it wraps. Without branches, the slope of the line would make them unpredictable
+	const int minor_first = first ? minorAt(first) : minor0;
+	const long long r = 2LL * first * dminor + steps - (minor_first - minor0) * two_steps;
+	long long e = dminor >= 0 ? r : two_steps - 1 - r;
+	const long long de = 2LL * abs(dminor);
+	const int major_first = major0 + first * major_step;
+	const int major_stride = x_major ? major_step : major_step * width;
+	const int minor_stride = (dminor >= 0 ? 1 : -1) * (x_major ? width : 1);
+
+	Color* p = pixels + (x_major ? minor_first * width + major_first : major_first * width + minor_first);
+	*p = c;
+	for (int count = last - first; count > 0; --count)
+	{
+		e += de;
+		const bool wrap = e >= two_steps;
+		e -= wrap ? two_steps : 0;
+		p += major_stride + (wrap ? minor_stride : 0);
+		*p = c;
 	}
+
+	const int major_last = major0 + last * major_step, minor_last = last == steps ? minor0 + dminor : minorAt(last);
+	Rect area(std::min(major_first, major_last), std::min(minor_first, minor_last),
+		abs(major_last - major_first) + 1, abs(minor_last - minor_first) + 1);
+	return x_major ? area : Rect(area.y, area.x, area.height, area.width);
+}
+
+// Clipped integer line, the name is kept from the DDA version
+void Image::DrawLineDDA(int x0, int y0, int x1, int y1, const Color& c)
+{
+	MarkDirty(rasterLine(pixels, width, height, x0, y0, x1, y1, c));
+}
+
+void Image::DrawLines(const Vector2* points, size_t count, const Color& c)
+{
+	Rect area;
+	for (size_t i = 1; i < count; ++i)
+		area.Union(rasterLine(pixels, width, height, (int)points[i - 1].x, (int)points[i - 1].y, (int)points[i].x, (int)points[i].y, c));
+	MarkDirty(area);
 }
 
 void Image::DrawRect(int x, int y, int w, int h, const Color& borderColor, int borderWidth, bool isFilled, const Color& fillColor) {
+	// The bounding box of every pixel written: a negative size (dragged up or left) still draws the sides,
+	// and so does a size under the border's, up to borderWidth out of the rect
+	MarkDirty(Rect(std::min(x, x + w) - borderWidth, std::min(y, y + h) - borderWidth, abs(w) + 2 * borderWidth, abs(h) + 2 * borderWidth));
+
 	// 1. RELLENO
 	if (isFilled)
 	{
@@ -137,6 +266,7 @@ void Image::ScanLineDDA(int x0, int x1, int y, const Color& c)
 	if (y < 0 || y >= (int)height) return;
 
 	if (x0 > x1) { int tmp = x0; x0 = x1; x1 = tmp; }
+	MarkDirty(Rect(x0, y, x1 - x0 + 1, 1));
 
 	for (int x = x0; x <= x1; x++)
 	{
@@ -155,80 +285,277 @@ void Image::DrawTriangle(const Vector2& p0, const Vector2& p1, const Vector2& p2
 
 	if (!isFilled) return;
 
-	// 2) BUILD EDGE TABLE
-	std::vector<std::vector<Edge>> ET(height); // ET[y] = edges that start at y
-
-	auto addEdge = [&](Vector2 a, Vector2 b)
-		{
-			int x0 = (int)a.x; int y0 = (int)a.y;
-			int x1 = (int)b.x; int y1 = (int)b.y;
-
-			if (y0 == y1) return; // ignore horizontal edges
+	// 2) FILL (half-space rasterizer, only visits the tiles inside the bounding box)
+	TileRasterizer& rasterizer = getRasterizer(width, height);
+	rasterizer.AddTriangle(p0, p1, p2, fillColor);
+	rasterizer.Flush(*this);
+}
 
-			// make y0 < y1
-			if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+void Image::FillTriangles(const Vector2* points, unsigned int num_points, const Color& c)
+{
+	if (num_points < 3) return;
 
-			Edge e;
-			e.yMax = y1;
-			e.x = (float)x0;
-			e.invSlope = (x1 - x0) / (float)(y1 - y0);
+	TileRasterizer& rasterizer = getRasterizer(width, height);
+	for (unsigned int i = 0; i + 2 < num_points; i += 3)
+		rasterizer.AddTriangle(points[i], points[i + 1], points[i + 2], c);
+	rasterizer.Flush(*this);
+}
 
-			if (y0 >= 0 && y0 < (int)height)
-				ET[y0].push_back(e);
-		};
+// Edge of a polygon for FillPolygon, crossing the scanlines [first, end)
+struct PolygonEdge
+{
+	float x0, y0;	// Upper end
+	float slope;	// dx/dy
+	int end;
+	int winding;	// +1 going down, -1 going up
+	int next;		// Next edge starting in the same scanline
+	float x;		// Crossing with the current scanline
+};
 
-	addEdge(p0, p1);
-	addEdge(p1, p2);
-	addEdge(p2, p0);
+void Image::FillPolygon(const Vector2* points, size_t count, const Color& c, FillRule rule)
+{
+	if (count < 3) return;
 
-	// 3) SCANLINE LOOP WITH AET
-	std::vector<Edge> AET;
+	// Scanlines touched by the polygon, sampled at the pixel centers
+	float min_x = points[0].x, max_x = points[0].x, min_y = points[0].y, max_y = points[0].y;
+	for (size_t i = 1; i < count; ++i)
+	{
+		min_x = std::min(min_x, points[i].x);
+		max_x = std::max(max_x, points[i].x);
+		min_y = std::min(min_y, points[i].y);
+		max_y = std::max(max_y, points[i].y);
+	}
+	const int y_begin = std::max(0, (int)std::ceil(std::max(min_y, -1.0f) - 0.5f));
+	const int y_end = std::min((int)height, (int)std::ceil(std::min(max_y, (float)height + 1.0f) - 0.5f));
+	if (y_begin >= y_end) return;
+
+	// Edge table: one bucket per scanline of the range with the edges starting in it, horizontal edges are skipped
+	ArenaScope scope(scratchArena());
+	PolygonEdge* edges = scratchArena().Allocate<PolygonEdge>(count);
+	int* buckets = scratchArena().Allocate<int>(y_end - y_begin);
+	int* active = scratchArena().Allocate<int>(count);
+	std::fill(buckets, buckets + (y_end - y_begin), -1);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Vector2& a = points[i];
+		const Vector2& b = points[(i + 1) % count];
+		const bool down = a.y < b.y;
+		const Vector2& top = down ? a : b;
+		const Vector2& bottom = down ? b : a;
+
+		int first = std::max(y_begin, (int)std::ceil(std::max(top.y, (float)y_begin - 1.0f) - 0.5f));
+		int end = std::min(y_end, (int)std::ceil(std::min(bottom.y, (float)y_end + 1.0f) - 0.5f));
+		if (first >= end)
+			continue;
+
+		PolygonEdge& edge = edges[i];
+		edge.x0 = top.x;
+		edge.y0 = top.y;
+		edge.slope = (bottom.x - top.x) / (bottom.y - top.y);
+		edge.end = end;
+		edge.winding = down ? 1 : -1;
+		edge.next = buckets[first - y_begin];
+		buckets[first - y_begin] = (int)i;
+	}
 
-	for (int y = 0; y < (int)height; y++)
+	// Active edge table sorted by x, insertion sort since the order barely changes from one scanline to the next
+	int num_active = 0;
+	for (int y = y_begin; y < y_end; ++y)
 	{
-		// add edges that start here
-		for (auto& e : ET[y]) AET.push_back(e);
+		const float center = y + 0.5f;
+		for (int e = buckets[y - y_begin]; e >= 0; e = edges[e].next)
+			active[num_active++] = e;
 
-		// remove edges where y == yMax
-		AET.erase(std::remove_if(AET.begin(), AET.end(),
-			[&](const Edge& e) { return y >= e.yMax; }),
-			AET.end());
+		int kept = 0;
+		for (int i = 0; i < num_active; ++i)
+		{
+			const int index = active[i];
+			PolygonEdge& edge = edges[index];
+			if (edge.end <= y)
+				continue;
+			edge.x = edge.x0 + (center - edge.y0) * edge.slope;
 
-		// sort by current x
-		std::sort(AET.begin(), AET.end(),
-			[](const Edge& a, const Edge& b) { return a.x < b.x; });
+			int j = kept++;
+			for (; j > 0 && edges[active[j - 1]].x > edge.x; --j)
+				active[j] = active[j - 1];
+			active[j] = index;
+		}
+		num_active = kept;
 
-		// fill pairs
-		for (int i = 0; i + 1 < (int)AET.size(); i += 2)
+		// Spans between the crossings where the polygon is inside, a pixel is filled if its center is in [left, right)
+		Color* row = pixels + y * width;
+		int winding = 0;
+		for (int i = 0; i + 1 < num_active; ++i)
 		{
-			int xStart = (int)std::ceil(AET[i].x);
-			int xEnd = (int)std::floor(AET[i + 1].x);
-			ScanLineDDA(xStart, xEnd, y, fillColor);
-		}
+			winding += rule == FILL_EVEN_ODD ? 1 : edges[active[i]].winding;
+			if (rule == FILL_EVEN_ODD ? (winding & 1) == 0 : winding == 0)
+				continue;
 
-		// update x for next scanline
-		for (auto& e : AET)
-			e.x += e.invSlope;
+			const int left = std::max(0, (int)std::ceil(std::max(edges[active[i]].x, -1.0f) - 0.5f));
+			const int right = std::min((int)width, (int)std::ceil(std::min(edges[active[i + 1]].x, (float)width + 1.0f) - 0.5f));
+			if (left < right)
+				std::fill(row + left, row + right, c);
+		}
 	}
+
+	const int x_begin = (int)std::floor(std::max(min_x, -1.0f)), x_end = (int)std::ceil(std::min(max_x, (float)width + 1.0f));
+	MarkDirty(Rect(x_begin, y_begin, x_end - x_begin, y_end - y_begin));
 }
 
-void Image::DrawImage(const Image& img, int x, int y)
+// Run of pixels [left, right] of the scanline y - dy already filled, its neighbours in the scanline y are still to be checked
+struct FillSpan
 {
-	for (int j = 0; j < (int)img.height; j++)
+	int y, left, right, dy;
+};
+
+// Span fill from (x,y) of the pixels where inside(pixel index) is true, filled marks the pixels written if the new color is also inside
+// A template so the test of every pixel is inlined, it runs several times per pixel
+template <typename Inside>
+static Rect floodFillSpans(Color* pixels, int width, int height, int x, int y, const Color& c, unsigned int* filled, const Inside& inside)
+{
+	// Fills [left, right] in the row y, the spans are filled whole so the stack only holds the edges still to explore
+	int min_x = x, max_x = x, min_y = y, max_y = y;
+	auto fill = [&](int left, int right, int py) {
+		std::fill(pixels + py * width + left, pixels + py * width + right + 1, c);
+		if (filled)
+			for (size_t i = (size_t)py * width + left; i <= (size_t)py * width + right; ++i)
+				filled[i >> 5] |= 1u << (i & 31);
+		min_x = std::min(min_x, left);
+		max_x = std::max(max_x, right);
+		min_y = std::min(min_y, py);
+		max_y = std::max(max_y, py);
+	};
+
+	// Stack of spans (Heckbert's seed fill), it grows by doubling in the scratch arena
+	int capacity = 256, size = 0;
+	FillSpan* stack = scratchArena().Allocate<FillSpan>(capacity);
+	auto push = [&](int py, int left, int right, int dy) {
+		if (py + dy < 0 || py + dy >= height)
+			return;
+		if (size == capacity)
+		{
+			FillSpan* bigger = scratchArena().Allocate<FillSpan>(capacity * 2);
+			memcpy(bigger, stack, size * sizeof(FillSpan));
+			stack = bigger;
+			capacity *= 2;
+		}
+		FillSpan span = { py + dy, left, right, dy };
+		stack[size++] = span;
+	};
+
+	push(y, x, x, 1);
+	push(y + 1, x, x, -1);
+	while (size > 0)
 	{
-		for (int i = 0; i < (int)img.width; i++)
+		const FillSpan span = stack[--size];
+		const int py = span.y, dy = span.dy, right = span.right;
+
+		// Extend to the left of the span, what goes past its left end leaks back in the other direction
+		int px = span.left;
+		while (px >= 0 && inside(py * width + px))
+			px--;
+		bool in_run = px < span.left;
+		int left = px + 1;
+		if (in_run && left < span.left)
+			push(py, left, span.left - 1, -dy);
+		px = span.left + 1;
+
+		// Runs of inside pixels touching the span, the part of a run past its right end also leaks back
+		while (true)
 		{
-			int px = x + i;
-			int py = y + j;
+			if (in_run)
+			{
+				while (px < width && inside(py * width + px))
+					px++;
+				fill(left, px - 1, py);
+				push(py, left, px - 1, dy);
+				if (px - 1 > right)
+					push(py, right + 1, px - 1, -dy);
+				px++;
+			}
+			while (px <= right && !inside(py * width + px))
+				px++;
+			if (px > right)
+				break;
+			left = px;
+			in_run = true;
+		}
+	}
 
-			if (px < 0 || px >= (int)width || py < 0 || py >= (int)height)
-				continue;
+	return Rect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+}
 
-			SetPixel((unsigned int)px, (unsigned int)py, img.GetPixel(i, j));
-		}
+
+Rect Image::FloodFill(int x, int y, const Color& c, int tolerance)
+{
+	if (x < 0 || x >= (int)width || y < 0 || y >= (int)height)
+		return Rect();
+
+	// Range of every channel that is filled
+	const Color seed = pixels[y * width + x];
+	tolerance = std::max(tolerance, 0);
+	int low[3], range[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		low[i] = std::max(seed.v[i] - tolerance, 0);
+		range[i] = std::min(seed.v[i] + tolerance, 255) - low[i];
+	}
+	auto matches = [&](const Color& p) {
+		return (unsigned int)(p.r - low[0]) <= (unsigned int)range[0] && (unsigned int)(p.g - low[1]) <= (unsigned int)range[1] &&
+			(unsigned int)(p.b - low[2]) <= (unsigned int)range[2];
+	};
+
+	ArenaScope scope(scratchArena());
+	Rect area;
+	if (!matches(c))
+	{
+		// The filled pixels stop matching, nothing else is needed to not visit them again
+		if (tolerance == 0)
+			area = floodFillSpans(pixels, width, height, x, y, c, NULL, [&](int i) { return pixels[i].r == seed.r && pixels[i].g == seed.g && pixels[i].b == seed.b; });
+		else
+			area = floodFillSpans(pixels, width, height, x, y, c, NULL, [&](int i) { return matches(pixels[i]); });
 	}
+	else if (tolerance > 0)
+	{
+		// The new color also matches, the filled pixels can not be told apart by color so a bit per pixel remembers them
+		const size_t words = ((size_t)width * height + 31) / 32;
+		unsigned int* filled = scratchArena().Allocate<unsigned int>(words);
+		memset(filled, 0, words * sizeof(unsigned int));
+		area = floodFillSpans(pixels, width, height, x, y, c, filled, [&](int i) { return matches(pixels[i]) && !(filled[i >> 5] & (1u << (i & 31))); });
+	}
+
+	MarkDirty(area);
+	return area;
 }
 
+void Image::DrawTriangleInterpolated(const Vector3& p0, const Vector3& p1, const Vector3& p2,
+	const Color& c0, const Color& c1, const Color& c2, FloatImage* zbuffer)
+{
+	TileRasterizer& rasterizer = getRasterizer(width, height);
+	rasterizer.AddTriangle(p0, p1, p2, c0, c1, c2);
+	rasterizer.Flush(*this, zbuffer);
+}
+
+void Image::DrawImage(const Image& img, int x, int y)
+{
+	MarkDirty(blitClipped(pixels, width, height, x, y, img.pixels, img.width, img.height, Rect(0, 0, img.width, img.height)));
+}
+
+void Image::DrawImage(const Image& img, int x, int y, const Rect& clip)
+{
+	// Source area that lands inside clip
+	Rect area = Rect(x, y, img.width, img.height).Intersection(clip);
+	if (area.IsEmpty())
+		return;
+
+	MarkDirty(blitClipped(pixels, width, height, area.x, area.y, img.pixels, img.width, img.height, Rect(area.x - x, area.y - y, area.width, area.height)));
+}
+
+void Image::DrawImageArea(const Image& img, const Rect& area, int x, int y)
+{
+	MarkDirty(blitClipped(pixels, width, height, x, y, img.pixels, img.width, img.height, area));
+}
 
 Image::~Image()
 {
@@ -246,17 +573,13 @@ void Image::Render()
 void Image::Resize(unsigned int width, unsigned int height)
 {
 	Color* new_pixels = new Color[width * height];
-	unsigned int min_width = this->width > width ? width : this->width;
-	unsigned int min_height = this->height > height ? height : this->height;
-
-	for (unsigned int x = 0; x < min_width; ++x)
-		for (unsigned int y = 0; y < min_height; ++y)
-			new_pixels[y * width + x] = GetPixel(x, y);
+	blitClipped(new_pixels, width, height, 0, 0, pixels, this->width, this->height, Rect(0, 0, this->width, this->height));
 
 	delete[] pixels;
 	this->width = width;
 	this->height = height;
 	pixels = new_pixels;
+	MarkAllDirty();
 }
 
 // Change image size and scale the content
@@ -264,34 +587,34 @@ void Image::Scale(unsigned int width, unsigned int height)
 {
 	Color* new_pixels = new Color[width * height];
 
-	for (unsigned int x = 0; x < width; ++x)
-		for (unsigned int y = 0; y < height; ++y)
-			new_pixels[y * width + x] = GetPixel((unsigned int)(this->width * (x / (float)width)), (unsigned int)(this->height * (y / (float)height)));
+	// The rows are independent, every task writes its own ones
+	parallelFor(height, [&](int y) {
+		unsigned int src_y = (unsigned int)(this->height * (y / (float)height));
+		for (unsigned int x = 0; x < width; ++x)
+			new_pixels[y * width + x] = GetPixel((unsigned int)(this->width * (x / (float)width)), src_y);
+	});
 
 	delete[] pixels;
 	this->width = width;
 	this->height = height;
 	pixels = new_pixels;
+	MarkAllDirty();
 }
 
 Image Image::GetArea(unsigned int start_x, unsigned int start_y, unsigned int width, unsigned int height)
 {
+	// The pixels outside this image stay black
 	Image result(width, height);
-	for (unsigned int x = 0; x < width; ++x)
-		for (unsigned int y = 0; y < height; ++y)
-		{
-			if ((x + start_x) < this->width && (y + start_y) < this->height)
-				result.SetPixelUnsafe(x, y, GetPixel(x + start_x, y + start_y));
-		}
+	blitClipped(result.pixels, width, height, 0, 0, pixels, this->width, this->height, Rect(start_x, start_y, width, height));
 	return result;
 }
 
 void Image::FlipY()
 {
 	int row_size = bytes_per_pixel * width;
-	Uint8* temp_row = new Uint8[row_size];
-#pragma omp simd
-	for (int y = 0; y < height * 0.5; y += 1)
+	ArenaScope scope(scratchArena());
+	Uint8* temp_row = scratchArena().Allocate<Uint8>(row_size);
+	for (int y = 0; y < (int)height / 2; y += 1)
 	{
 		Uint8* pos = (Uint8*)pixels + y * row_size;
 		memcpy(temp_row, pos, row_size);
@@ -299,71 +622,50 @@ void Image::FlipY()
 		memcpy(pos, pos2, row_size);
 		memcpy(pos2, temp_row, row_size);
 	}
-	delete[] temp_row;
+	MarkAllDirty();
 }
 
 bool Image::LoadPNG(const char* filename, bool flip_y)
 {
 	std::string sfullPath = absResPath(filename);
-	std::ifstream file(sfullPath, std::ios::in | std::ios::binary | std::ios::ate);
-
-	// Get filesize
-	std::streamsize size = 0;
-	if (file.seekg(0, std::ios::end).good()) size = file.tellg();
-	if (file.seekg(0, std::ios::beg).good()) size -= file.tellg();
 
-	if (!size) {
+	// The decoder reads the mapped file in place
+	MappedFile file;
+	if (!file.Open(sfullPath) || file.GetSize() == 0) {
 		std::cerr << "--- Failed to load file: " << sfullPath.c_str() << std::endl;
 		return false;
 	}
-
-	std::vector<unsigned char> buffer;
-
-	// Read contents of the file into the vector
-	if (size > 0)
+	const unsigned char* data = (const unsigned char*)file.GetData();
+
+	// The size first, then the rows are decoded straight into the pixels (always 3 channels)
+	unsigned int new_width = 0, new_height = 0;
+	Color* new_pixels = NULL;
+	int error = decodePNG(NULL, new_width, new_height, data, file.GetSize());
+
+	// The size comes from the header: an empty image or one whose bytes do not fit in an int (the pixels are indexed with ints) is rejected
+	// before allocating, the product of the two would wrap around and the decoder would write past the buffer
+	if (error == 0 && (new_width == 0 || new_height == 0 || new_width > INT_MAX / sizeof(Color) / new_height))
+		error = -1;
+	if (error == 0)
 	{
-		buffer.resize((size_t)size);
-		file.read((char*)(&buffer[0]), size);
+		new_pixels = new Color[(size_t)new_width * new_height];
+		error = decodePNG((unsigned char*)new_pixels, new_width, new_height, data, file.GetSize(), flip_y);
 	}
-	else
-		buffer.clear();
 
-	std::vector<unsigned char> out_image;
-
-	if (decodePNG(out_image, width, height, buffer.empty() ? 0 : &buffer[0], (unsigned long)buffer.size(), true) != 0) {
+	if (error != 0) {
+		delete[] new_pixels;
 		std::cerr << "--- Failed to load file: " << sfullPath.c_str() << std::endl;
 		return false;
 	}
 
-	size_t bufferSize = out_image.size();
-	unsigned int originalBytesPerPixel = (unsigned int)bufferSize / (width * height);
-
-	// Force 3 channels
+	if (pixels) delete[] pixels;
+	pixels = new_pixels;
+	width = new_width;
+	height = new_height;
 	bytes_per_pixel = 3;
 
-	if (originalBytesPerPixel == 3) {
-		if (pixels) delete[] pixels;
-		pixels = new Color[bufferSize];
-		memcpy(pixels, &out_image[0], bufferSize);
-	}
-	else if (originalBytesPerPixel == 4) {
-		if (pixels) delete[] pixels;
-
-		unsigned int newBufferSize = width * height * bytes_per_pixel;
-		pixels = new Color[newBufferSize];
-
-		unsigned int k = 0;
-		for (unsigned int i = 0; i < bufferSize; i += originalBytesPerPixel) {
-			pixels[k] = Color(out_image[i], out_image[i + 1], out_image[i + 2]);
-			k++;
-		}
-	}
-
-	// Flip pixels in Y
-	if (flip_y)
-		FlipY();
-
-	std::cout << "+++ File loaded: " << sfullPath.c_str() << std::endl;
+	// No line per file, the loads run on worker threads while the frames are drawn (AssetLoader prints when all are done)
+	MarkAllDirty();
 
 	return true;
 }
@@ -452,17 +754,18 @@ bool Image::LoadTGA(const char* filename, bool flip_y)
 	delete[] tgainfo->data;
 	delete tgainfo;
 
+	MarkAllDirty();
 	std::cout << "+++ File loaded: " << sfullPath.c_str() << std::endl;
 
 	return true;
 }
 
 // Saves the image to a TGA file
-bool Image::SaveTGA(const char* filename)
+bool Image::SaveTGA(const char* filename, bool res_path)
 {
 	unsigned char TGAheader[12] = { 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
-	std::string fullPath = absResPath(filename);
+	std::string fullPath = res_path ? absResPath(filename) : std::string(filename);
 	FILE* file = fopen(fullPath.c_str(), "wb");
 	if (file == NULL)
 	{
@@ -502,17 +805,29 @@ bool Image::SaveTGA(const char* filename)
 	return true;
 }
 
-#ifndef IGNORE_LAMBDAS
+// Bytes of every band, small enough to stay in the L2 cache of the core that runs it
+#define ROW_BAND_BYTES (64 * 1024)
 
-// You can apply and algorithm for two images and store the result in the first one
-// ForEachPixel( img, img2, [](Color a, Color b) { return a + b; } );
-template <typename F>
-void ForEachPixel(Image& img, const Image& img2, F f) {
-	for (unsigned int pos = 0; pos < img.width * img.height; ++pos)
-		img.pixels[pos] = f(img.pixels[pos], img2.pixels[pos]);
-}
+void forEachRowBand(ExecutionPolicy policy, unsigned int width, unsigned int height, unsigned int bytes_per_pixel,
+	const std::function<void(unsigned int begin, unsigned int end)>& band)
+{
+	if (width == 0 || height == 0)
+		return;
 
-#endif
+	if (policy == EXECUTION_SEQUENCED)
+	{
+		band(0, width * height);
+		return;
+	}
+
+	const unsigned int rows = std::max(1u, ROW_BAND_BYTES / (width * bytes_per_pixel));
+	const int num_bands = (height + rows - 1) / rows;
+	parallelFor(num_bands, [&](int i) {
+		unsigned int first_row = i * rows;
+		unsigned int last_row = std::min(first_row + rows, height);
+		band(first_row * width, last_row * width);
+	});
+}
 
 FloatImage::FloatImage(unsigned int width, unsigned int height)
 {
@@ -545,7 +860,7 @@ FloatImage& FloatImage::operator = (const FloatImage& c)
 	height = c.height;
 	if (c.pixels)
 	{
-		pixels = new float[width * height * sizeof(float)];
+		pixels = new float[width * height];
 		memcpy(pixels, c.pixels, width * height * sizeof(float));
 	}
 	return *this;
@@ -561,12 +876,7 @@ FloatImage::~FloatImage()
 void FloatImage::Resize(unsigned int width, unsigned int height)
 {
 	float* new_pixels = new float[width * height];
-	unsigned int min_width = this->width > width ? width : this->width;
-	unsigned int min_height = this->height > height ? height : this->height;
-
-	for (unsigned int x = 0; x < min_width; ++x)
-		for (unsigned int y = 0; y < min_height; ++y)
-			new_pixels[y * width + x] = GetPixel(x, y);
+	blitClipped(new_pixels, width, height, 0, 0, pixels, this->width, this->height, Rect(0, 0, this->width, this->height));
 
 	delete[] pixels;
 	this->width = width;
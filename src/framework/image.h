@@ -8,6 +8,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <iostream>
+#include <functional>
 #include "framework.h"
 
 //remove unsafe warnings
@@ -20,6 +21,21 @@ class FloatImage;
 class Entity;
 class Camera;
 
+// How ForEachPixel runs the callback, like the C++17 std::execution policies
+// PARALLEL: bands of rows run in different threads, UNSEQUENCED: also lets the compiler vectorize the loop of every band
+enum ExecutionPolicy { EXECUTION_SEQUENCED, EXECUTION_PARALLEL, EXECUTION_PARALLEL_UNSEQUENCED };
+
+// Which points FillPolygon considers inside when the outline crosses itself (like SVG fill-rule)
+// EVEN_ODD: crossed an odd number of times from outside, NON_ZERO: the outline winds around them
+enum FillRule { FILL_EVEN_ODD, FILL_NON_ZERO };
+
+// Calls band(begin, end) with ranges of pixels of whole rows that fit in the cache, in parallel if the policy allows it
+void forEachRowBand(ExecutionPolicy policy, unsigned int width, unsigned int height, unsigned int bytes_per_pixel,
+	const std::function<void(unsigned int begin, unsigned int end)>& band);
+template <typename F> inline void forEachRowBand(ExecutionPolicy policy, unsigned int width, unsigned int height, unsigned int bytes_per_pixel, const F& band) {
+	forEachRowBand(policy, width, height, bytes_per_pixel, std::function<void(unsigned int, unsigned int)>([&band](unsigned int begin, unsigned int end) { band(begin, end); }));
+}
+
 // A matrix of pixels
 class Image
 {
@@ -38,6 +54,10 @@ public:
 
 	Color* pixels;
 
+	// Area written by the draw calls since the last ClearDirty (clipped to the image)
+	// Writes done directly with SetPixel or the pixels array are not tracked, call MarkDirty after them
+	Rect dirty_rect;
+
 	// Constructors
 	Image();
 	Image(unsigned int width, unsigned int height);
@@ -47,8 +67,15 @@ public:
 	// Destructor
 	~Image();
 
+	// Exchanges the pixels (and size) with other without copying them
+	void Swap(Image& other);
+
 	void Render();
 
+	void MarkDirty(const Rect& area) { dirty_rect.Union(area.Intersection(Rect(0, 0, width, height))); }
+	void MarkAllDirty() { dirty_rect = Rect(0, 0, width, height); }
+	void ClearDirty() { dirty_rect = Rect(); }
+
 	// Get the pixel at position x,y
 	Color GetPixel(unsigned int x, unsigned int y) const { return pixels[y * width + x]; }
 	Color& GetPixelRef(unsigned int x, unsigned int y) { return pixels[y * width + x]; }
@@ -68,7 +95,7 @@ public:
 	void FlipY(); // Flip the image top-down
 
 	// Fill the image with the color C
-	void Fill(const Color& c) { for (unsigned int pos = 0; pos < width * height; ++pos) pixels[pos] = c; }
+	void Fill(const Color& c) { for (unsigned int pos = 0; pos < width * height; ++pos) pixels[pos] = c; MarkAllDirty(); }
 
 	// Returns a new image with the area from (startx,starty) of size width,height
 	Image GetArea(unsigned int start_x, unsigned int start_y, unsigned int width, unsigned int height);
@@ -76,18 +103,38 @@ public:
 	// Save or load images from the hard drive
 	bool LoadPNG(const char* filename, bool flip_y = true);
 	bool LoadTGA(const char* filename, bool flip_y = false);
-	bool SaveTGA(const char* filename);
+	bool SaveTGA(const char* filename, bool res_path = true); // res_path: the filename is relative to the res folder
 
 	//Dibuixar linies fent servir l'algoritme DDA
+	// Clipped to the image before drawing, the pixels outside cost nothing
 	void DrawLineDDA(int x0, int y0, int x1, int y1, const Color& c);
 
+	// Polyline through count points (count - 1 segments), marked dirty once for the whole batch
+	void DrawLines(const Vector2* points, size_t count, const Color& c);
+
 	void Image::DrawRect(int x, int y, int w, int h, const Color& borderColor, int borderWidth, bool isFilled, const Color& fillColor);
 
 	void ScanLineDDA(int x0, int x1, int y, const Color& c);
 	void DrawTriangle(const Vector2& p0, const Vector2& p1, const Vector2& p2,
 		const Color& borderColor, bool isFilled, const Color& fillColor);
 
+	// Fills a batch of triangles (3 consecutive points per triangle) with the tiled half-space rasterizer
+	void FillTriangles(const Vector2* points, unsigned int num_points, const Color& c);
+
+	// Fills a polygon of any number of vertices (the last one joins the first), convex or not, with holes if it crosses itself
+	void FillPolygon(const Vector2* points, size_t count, const Color& c, FillRule rule = FILL_EVEN_ODD);
+
+	// Paint bucket: fills the area connected to (x,y) (4 neighbours) whose color differs at most tolerance per channel from the one at (x,y)
+	// Returns the area written
+	Rect FloodFill(int x, int y, const Color& c, int tolerance = 0);
+
+	// Fills a triangle interpolating the vertex colors, p.z is tested against the zbuffer (if any) and smaller is closer
+	void DrawTriangleInterpolated(const Vector3& p0, const Vector3& p1, const Vector3& p2,
+		const Color& c0, const Color& c1, const Color& c2, FloatImage* zbuffer = NULL);
+
 	void DrawImage(const Image& image, int x, int y);
+	void DrawImage(const Image& image, int x, int y, const Rect& clip); // Only writes the pixels inside clip
+	void DrawImageArea(const Image& image, const Rect& area, int x, int y); // Only the area of image (an icon of an Atlas)
 
 
 
@@ -102,11 +149,75 @@ public:
 	{
 		for (unsigned int pos = 0; pos < width * height; ++pos)
 			pixels[pos] = callback(pixels[pos]);
+		MarkAllDirty();
+		return *this;
+	}
+
+// The same with an execution policy:   img.ForEachPixel(EXECUTION_PARALLEL, [](Color c) { return c*2; });
+// With a parallel policy the callback is called from several threads at the same time
+	template <typename F>
+	Image& ForEachPixel(ExecutionPolicy policy, F callback)
+	{
+		Color* data = pixels;
+		forEachRowBand(policy, width, height, sizeof(Color), [&](unsigned int begin, unsigned int end) {
+			if (policy == EXECUTION_PARALLEL_UNSEQUENCED)
+			{
+#pragma omp simd
+				for (int pos = (int)begin; pos < (int)end; ++pos)
+					data[pos] = callback(data[pos]);
+			}
+			else
+			{
+				for (unsigned int pos = begin; pos < end; ++pos)
+					data[pos] = callback(data[pos]);
+			}
+		});
+		MarkAllDirty();
 		return *this;
 	}
 #endif
 };
 
+#ifndef IGNORE_LAMBDAS
+
+// You can apply and algorithm for two images and store the result in the first one (only the area both images have)
+// ForEachPixel( img, img2, [](Color a, Color b) { return a + b; } );
+template <typename F>
+void ForEachPixel(Image& img, const Image& img2, F f)
+{
+	ForEachPixel(EXECUTION_SEQUENCED, img, img2, f);
+}
+
+// ForEachPixel( EXECUTION_PARALLEL, img, img2, [](Color a, Color b) { return a + b; } );
+template <typename F>
+void ForEachPixel(ExecutionPolicy policy, Image& img, const Image& img2, F f)
+{
+	const unsigned int width = std::min(img.width, img2.width);
+	const unsigned int height = std::min(img.height, img2.height);
+	forEachRowBand(policy, width, height, sizeof(Color), [&](unsigned int begin, unsigned int end) {
+		// Rows of the band, the images may have different widths
+		for (unsigned int y = begin / width; y < end / width; ++y)
+		{
+			Color* dst = img.pixels + y * img.width;
+			const Color* src = img2.pixels + y * img2.width;
+			if (policy == EXECUTION_PARALLEL_UNSEQUENCED)
+			{
+#pragma omp simd
+				for (int x = 0; x < (int)width; ++x)
+					dst[x] = f(dst[x], src[x]);
+			}
+			else
+			{
+				for (unsigned int x = 0; x < width; ++x)
+					dst[x] = f(dst[x], src[x]);
+			}
+		}
+	});
+	img.MarkDirty(Rect(0, 0, width, height));
+}
+
+#endif
+
 // Image storing one float per pixel instead of a 3 or 4 component Color
 
 class FloatImage
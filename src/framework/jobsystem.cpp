@@ -0,0 +1,310 @@
+#include "jobsystem.h"
+
+struct Job
+{
+	std::function<void()> work;
+
+	// Dependencies not finished yet (plus one while it is being submitted)
+	std::atomic<int> pending;
+
+	// Jobs waiting for this one
+	std::mutex mutex;
+	std::vector<JobHandle> continuations;
+	std::atomic<bool> done;
+};
+
+// State of a ParallelFor shared with the workers that help, a helper job that starts after the loop
+// finished only reads next (so the callback of the caller is never used after it returns)
+struct ParallelForState
+{
+	std::atomic<int> next;
+	std::atomic<int> working;
+	int count;
+	int chunk;
+	const std::function<void(int)>* callback;
+
+	void Run()
+	{
+		working++;
+		for (int start = next.fetch_add(chunk); start < count; start = next.fetch_add(chunk))
+		{
+			int end = std::min(start + chunk, count);
+			for (int i = start; i < end; ++i)
+				(*callback)(i);
+		}
+		working--;
+	}
+};
+
+// Queue of the worker running in this thread (-1 for the threads that are not workers)
+static thread_local int t_worker_index = -1;
+static thread_local JobSystem* t_worker_system = NULL;
+
+JobSystem::JobSystem(int num_threads)
+{
+	queued_jobs = 0;
+	next_queue = 0;
+	active_for = NULL;
+	active_for_users = 0;
+	active_for_generation = 0;
+	running = false;
+	Start(num_threads);
+}
+
+JobSystem::~JobSystem()
+{
+	Stop();
+}
+
+JobSystem* JobSystem::Get()
+{
+	static JobSystem instance;
+	return &instance;
+}
+
+void JobSystem::SetNumThreads(int num_threads)
+{
+	Stop();
+	Start(num_threads);
+}
+
+void JobSystem::Start(int num_threads)
+{
+	if (num_threads <= 0)
+		num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	// There is always a queue, the jobs submitted without workers wait there for a Wait
+	for (int i = 0; i < std::max(1, num_threads - 1); ++i)
+		queues.push_back(new WorkQueue());
+
+	running = true;
+	for (int i = 0; i < num_threads - 1; ++i)
+		workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+}
+
+void JobSystem::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		running = false;
+	}
+	wake_up.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	workers.clear();
+
+	// Whatever is still queued runs here so nobody waits forever
+	while (RunOne());
+	for (size_t i = 0; i < queues.size(); ++i)
+		delete queues[i];
+	queues.clear();
+}
+
+void JobSystem::WorkerLoop(int index)
+{
+	t_worker_index = index;
+	t_worker_system = this;
+
+	unsigned int helped_generation = active_for_generation;
+	while (true)
+	{
+		if (HelpActiveFor(helped_generation) || RunOne())
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		wake_up.wait(lock, [&]() { return queued_jobs > 0 || active_for_generation != helped_generation || !running; });
+		if (!running)
+			break;
+	}
+}
+
+JobHandle JobSystem::Submit(const std::function<void()>& work, const std::vector<JobHandle>& dependencies)
+{
+	JobHandle job = std::make_shared<Job>();
+	job->work = work;
+	job->pending = (int)dependencies.size() + 1;
+	job->done = false;
+
+	// The dependencies that already finished will not tell this job
+	for (size_t i = 0; i < dependencies.size(); ++i)
+	{
+		Job* dependency = dependencies[i].get();
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->done)
+			job->pending--;
+		else
+			dependency->continuations.push_back(job);
+	}
+
+	if (--job->pending == 0)
+		Schedule(job);
+	return job;
+}
+
+void JobSystem::Schedule(const JobHandle& job)
+{
+	if (workers.empty())
+	{
+		Execute(job);
+		return;
+	}
+
+	// Workers push to their own queue, other threads spread the jobs
+	int index = t_worker_system == this ? t_worker_index : (int)(next_queue++ % queues.size());
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->jobs.push_back(job);
+	}
+	queued_jobs++;
+
+	// Taking the lock makes sure a worker that just found nothing is already waiting
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	wake_up.notify_one();
+}
+
+void JobSystem::Execute(const JobHandle& job)
+{
+	job->work();
+
+	std::vector<JobHandle> continuations;
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		job->done = true;
+		continuations.swap(job->continuations);
+	}
+	for (size_t i = 0; i < continuations.size(); ++i)
+		if (--continuations[i]->pending == 0)
+			Schedule(continuations[i]);
+}
+
+bool JobSystem::RunOne()
+{
+	if (queued_jobs == 0)
+		return false;
+
+	// The newest job of the own queue (its data is still in cache), then the oldest of the others
+	const int own = t_worker_system == this ? t_worker_index : 0;
+	const int num_queues = (int)queues.size();
+	JobHandle job;
+	for (int i = 0; i < num_queues && !job; ++i)
+	{
+		WorkQueue* queue = queues[(own + i) % num_queues];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (queue->jobs.empty())
+			continue;
+		if (i == 0 && t_worker_system == this)
+		{
+			job = queue->jobs.back();
+			queue->jobs.pop_back();
+		}
+		else
+		{
+			job = queue->jobs.front();
+			queue->jobs.pop_front();
+		}
+	}
+
+	if (!job)
+		return false;
+	queued_jobs--;
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Wait(const JobHandle& job)
+{
+	while (job && !job->done)
+		if (!RunOne())
+			std::this_thread::yield();
+}
+
+bool JobSystem::IsDone(const JobHandle& job) const
+{
+	return !job || job->done;
+}
+
+
+bool JobSystem::HelpActiveFor(unsigned int& helped_generation)
+{
+	unsigned int generation = active_for_generation;
+	if (generation == helped_generation)
+		return false;
+
+	active_for_users++;
+	ParallelForState* state = active_for;
+	if (state)
+		state->Run();
+	active_for_users--;
+	helped_generation = generation;
+	return state != NULL;
+}
+
+void JobSystem::ParallelFor(int count, const std::function<void(int)>& callback, int min_chunk)
+{
+	// Around 4 chunks per thread so the threads that finish first take the rest
+	int chunk = std::max(std::max(min_chunk, 1), count / (GetNumThreads() * 4));
+	int num_chunks = (count + chunk - 1) / chunk;
+	int num_helpers = std::min((int)workers.size(), num_chunks - 1);
+
+	// Not worth to wake up other threads
+	if (num_helpers <= 0)
+	{
+		for (int i = 0; i < count; ++i)
+			callback(i);
+		return;
+	}
+
+	// Common case, no other loop running: the state lives in the stack and the idle workers take it from active_for
+	ParallelForState local_state;
+	local_state.next = 0;
+	local_state.working = 0;
+	local_state.count = count;
+	local_state.chunk = chunk;
+	local_state.callback = &callback;
+	ParallelForState* expected = NULL;
+	if (active_for.compare_exchange_strong(expected, &local_state))
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			active_for_generation++;
+		}
+		wake_up.notify_all();
+
+		local_state.Run();
+		active_for = NULL;
+		while (active_for_users > 0)
+			std::this_thread::yield();
+		return;
+	}
+
+	// Nested or concurrent loops go through jobs, which outlive the call so the state is shared with them
+	std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+	state->next = 0;
+	state->working = 0;
+	state->count = count;
+	state->chunk = chunk;
+	state->callback = &callback;
+
+	for (int i = 0; i < num_helpers; ++i)
+		Submit([state]() { state->Run(); });
+
+	// The caller works too instead of waiting, and never runs other jobs in the middle of its loop
+	state->Run();
+	while (state->working > 0)
+		std::this_thread::yield();
+}
+
+void JobSystem::ParallelForTiles(const Rect& area, int tile_size, const std::function<void(const Rect&)>& callback)
+{
+	if (area.IsEmpty() || tile_size <= 0)
+		return;
+
+	const int tiles_x = (area.width + tile_size - 1) / tile_size;
+	const int tiles_y = (area.height + tile_size - 1) / tile_size;
+	ParallelFor(tiles_x * tiles_y, [&](int i) {
+		Rect tile(area.x + (i % tiles_x) * tile_size, area.y + (i / tiles_x) * tile_size, tile_size, tile_size);
+		callback(tile.Intersection(area));
+	});
+}
@@ -0,0 +1,91 @@
+/*
+	+ The JobSystem is a pool of worker threads created once and reused by every parallel loop of the framework.
+	+ Every worker has its own queue of jobs, it runs the newest job of its queue and when it is empty steals the oldest of another one.
+	+ Jobs can depend on other jobs, they are queued when all their dependencies have finished.
+	+ ParallelFor splits a range of indices (or an area in tiles) in chunks that the caller and the workers take until there are no more.
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "framework.h"
+
+struct Job;
+struct ParallelForState;
+typedef std::shared_ptr<Job> JobHandle;
+
+class JobSystem
+{
+public:
+	// num_threads counts the thread that calls ParallelFor, 0 uses one per CPU core
+	JobSystem(int num_threads = 0);
+	~JobSystem();
+
+	// The instance used by parallelFor, created the first time it is needed
+	static JobSystem* Get();
+
+	// Stops the workers and starts num_threads - 1 new ones (0 uses one per CPU core), call it when no jobs are running
+	void SetNumThreads(int num_threads);
+	int GetNumThreads() const { return (int)workers.size() + 1; }
+
+	// Queues the work to run after the dependencies finish, without worker threads it runs right away
+	JobHandle Submit(const std::function<void()>& work, const std::vector<JobHandle>& dependencies = std::vector<JobHandle>());
+
+	// Runs other queued jobs while the job has not finished
+	void Wait(const JobHandle& job);
+	bool IsDone(const JobHandle& job) const;
+
+	// Calls callback(i) for every i in [0, count), returns when all of them have finished
+	// min_chunk is the minimum number of indices taken at once, use more when every call is very cheap
+	void ParallelFor(int count, const std::function<void(int)>& callback, int min_chunk = 1);
+
+	// Calls callback(tile) for the tiles of tile_size x tile_size pixels that cover the area
+	void ParallelForTiles(const Rect& area, int tile_size, const std::function<void(const Rect&)>& callback);
+
+	// Lambdas are passed by reference: a std::function made from a lambda with many captures allocates, one with a single reference does not
+	template <typename F> void ParallelFor(int count, const F& callback, int min_chunk = 1) { ParallelFor(count, std::function<void(int)>([&callback](int i) { callback(i); }), min_chunk); }
+	template <typename F> void ParallelForTiles(const Rect& area, int tile_size, const F& callback) { ParallelForTiles(area, tile_size, std::function<void(const Rect&)>([&callback](const Rect& tile) { callback(tile); })); }
+
+private:
+	// Not copyable, the workers belong to a single system
+	JobSystem(const JobSystem&);
+	JobSystem& operator = (const JobSystem&);
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<JobHandle> jobs;
+	};
+
+	void Start(int num_threads);
+	void Stop();
+	void WorkerLoop(int index);
+	void Schedule(const JobHandle& job);
+	void Execute(const JobHandle& job);
+	bool RunOne();
+
+	std::vector<std::thread> workers;
+	std::vector<WorkQueue*> queues;
+	std::atomic<int> queued_jobs;
+	std::atomic<unsigned int> next_queue;
+
+	// The ParallelFor running now (one at a time), the idle workers join it without any job being allocated
+	// Workers count themselves in active_for_users before reading it, so the caller knows when nobody uses it anymore
+	// The generation changes with every loop, a worker that already helped in it goes back to sleep
+	std::atomic<ParallelForState*> active_for;
+	std::atomic<int> active_for_users;
+	std::atomic<unsigned int> active_for_generation;
+	bool HelpActiveFor(unsigned int& helped_generation);
+
+	// Sleeping workers wait here until there are jobs
+	std::mutex sleep_mutex;
+	std::condition_variable wake_up;
+	bool running;
+};
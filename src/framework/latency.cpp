@@ -0,0 +1,102 @@
+#include "latency.h"
+#include "SDL.h"
+
+#include <algorithm>
+#include <cstdio>
+
+const float LatencyRecorder::BUCKET_MS = 0.5f;
+
+LatencyRecorder::LatencyRecorder()
+{
+	Reset();
+}
+
+void LatencyRecorder::Reset()
+{
+	pending = 0;
+	for (int s = 0; s < NUM_SERIES; ++s)
+	{
+		for (int b = 0; b < NUM_BUCKETS; ++b)
+			histograms[s][b] = 0;
+		sum[s] = 0.0;
+		max[s] = 0.0f;
+	}
+	frames = 0;
+}
+
+void LatencyRecorder::OnInput(unsigned int timestamp)
+{
+	// The event waited in the queue of SDL since its timestamp (ms), the rest is measured with the high resolution clock
+	Clock::time_point now = Clock::now();
+	Clock::time_point arrival = now - std::chrono::milliseconds(SDL_GetTicks() - timestamp);
+	if (pending == 0 || arrival < oldest_input)
+		oldest_input = arrival;
+	if (pending == 0 || arrival > newest_input)
+		newest_input = arrival;
+	pending++;
+}
+
+void LatencyRecorder::OnPresented()
+{
+	if (pending == 0)
+		return;
+
+	Clock::time_point now = Clock::now();
+	float latency[NUM_SERIES];
+	latency[SERIES_OLDEST] = std::chrono::duration<float, std::milli>(now - oldest_input).count();
+	latency[SERIES_NEWEST] = std::chrono::duration<float, std::milli>(now - newest_input).count();
+	for (int s = 0; s < NUM_SERIES; ++s)
+	{
+		int bucket = std::min((int)(latency[s] / BUCKET_MS), NUM_BUCKETS - 1);
+		histograms[s][std::max(bucket, 0)]++;
+		sum[s] += latency[s];
+		max[s] = std::max(max[s], latency[s]);
+	}
+	frames++;
+	pending = 0;
+}
+
+LatencyRecorder::Stats LatencyRecorder::GetStats(Series series) const
+{
+	Stats stats = { frames, 0.0f, 0.0f, 0.0f, 0.0f };
+	if (frames == 0)
+		return stats;
+
+	stats.avg = (float)(sum[series] / frames);
+	stats.max = max[series];
+
+	// The first bucket where the frames counted so far reach the percentile
+	const unsigned int p50_frames = (frames + 1) / 2, p99_frames = std::max(1u, (unsigned int)(frames * 0.99f));
+	unsigned int counted = 0;
+	for (int b = 0; b < NUM_BUCKETS; ++b)
+	{
+		unsigned int next = counted + histograms[series][b];
+		if (counted < p50_frames && next >= p50_frames)
+			stats.p50 = (b + 1) * BUCKET_MS;
+		if (counted < p99_frames && next >= p99_frames)
+			stats.p99 = (b + 1) * BUCKET_MS;
+		counted = next;
+	}
+	return stats;
+}
+
+void LatencyRecorder::GetSummary(char* text, size_t size) const
+{
+	Stats oldest = GetStats(SERIES_OLDEST), newest = GetStats(SERIES_NEWEST);
+	snprintf(text, size, "input to present, %u frames: oldest input %.1f/%.1f/%.1f/%.1f, newest input %.1f/%.1f/%.1f/%.1f ms (avg/p50/p99/max)",
+		frames, oldest.avg, oldest.p50, oldest.p99, oldest.max, newest.avg, newest.p50, newest.p99, newest.max);
+}
+
+bool LatencyRecorder::SaveCSV(const char* filename, const char* label) const
+{
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+
+	fprintf(file, "label,start_ms,end_ms,oldest_input,newest_input\n");
+	for (int b = 0; b < NUM_BUCKETS; ++b)
+		fprintf(file, "%s,%.2f,%.2f,%u,%u\n", label, b * BUCKET_MS, b == NUM_BUCKETS - 1 ? -1.0f : (b + 1) * BUCKET_MS,
+			histograms[SERIES_OLDEST][b], histograms[SERIES_NEWEST][b]);
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,61 @@
+/*
+	+ The LatencyRecorder measures the time from an input event to the end of the swap of the first frame that shows it (input to photon,
+	  minus what the display adds after the swap).
+	+ The inputs handled since the last present are pending, OnPresented closes them: every frame with input adds the latency of its
+	  oldest input (the worst one, it waited the whole frame) and of its newest input to two histograms of BUCKET_MS buckets.
+	+ SaveCSV writes the histograms with a label of the configuration, so the files of several runs (present paths, threads,
+	  event-driven or continuous loop) can be put together and compared.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <chrono>
+
+class LatencyRecorder
+{
+public:
+	// The last bucket also counts everything slower
+	static const int NUM_BUCKETS = 200;
+	static const float BUCKET_MS;
+
+	enum Series { SERIES_OLDEST, SERIES_NEWEST, NUM_SERIES };
+
+	// Times in milliseconds
+	struct Stats
+	{
+		unsigned int frames;
+		float avg;
+		float p50;
+		float p99;
+		float max;
+	};
+
+	LatencyRecorder();
+
+	// An input event was handled, timestamp is the one SDL gave it when it was queued (SDL_GetTicks)
+	void OnInput(unsigned int timestamp);
+	// The swap of a frame returned, the pending inputs are on screen
+	void OnPresented();
+
+	void Reset();
+
+	// Percentiles are the upper end of their bucket
+	Stats GetStats(Series series) const;
+	// Writes the frames and avg/p50/p99/max of both series into text (no allocations)
+	void GetSummary(char* text, size_t size) const;
+
+	// Columns: label, bucket start and end in ms (-1 for the last one), frames by their oldest input, frames by their newest input
+	bool SaveCSV(const char* filename, const char* label) const;
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	int pending;
+	Clock::time_point oldest_input, newest_input;
+
+	unsigned int histograms[NUM_SERIES][NUM_BUCKETS];
+	double sum[NUM_SERIES];
+	float max[NUM_SERIES];
+	unsigned int frames;
+};
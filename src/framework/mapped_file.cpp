@@ -0,0 +1,99 @@
+#include "mapped_file.h"
+
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	data = NULL;
+	size = 0;
+#ifdef WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+#ifdef WIN32
+	file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_handle == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	data = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	size = (size_t)file_size.QuadPart;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps its own reference to the file
+
+	if (mapping == MAP_FAILED)
+		return false;
+
+	data = (const char*)mapping;
+	size = (size_t)st.st_size;
+#endif
+
+	if (data == NULL)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+	mapping_handle = NULL;
+	file_handle = INVALID_HANDLE_VALUE;
+#else
+	if (data)
+		munmap((void*)data, size);
+#endif
+	data = NULL;
+	size = 0;
+}
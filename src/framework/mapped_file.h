@@ -0,0 +1,36 @@
+/*
+	+ This class maps a whole file in memory (read only) so it can be parsed in place without copies.
+*/
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Maps the file at the given full path, returns false if it could not be opened
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsOpen() const { return data != NULL; }
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	// Not copyable, the mapping belongs to a single object
+	MappedFile(const MappedFile&);
+	MappedFile& operator = (const MappedFile&);
+
+	const char* data;
+	size_t size;
+
+#ifdef WIN32
+	void* file_handle;
+	void* mapping_handle;
+#endif
+};
@@ -1,13 +1,26 @@
 #include "mesh.h"
 #include "utils.h"
 #include "camera.h"
+#include "mapped_file.h"
 
 #include <string>
-#include <sys/stat.h>
 #include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <sys/stat.h>
 
 Mesh::Mesh()
 {
+	use_buffers = false;
+	interleaved = true;
+	buffers_dirty = true;
+	vertices_vbo = normals_vbo = uvs_vbo = indices_vbo = 0;
+	vao = 0;
+}
+
+Mesh::~Mesh()
+{
+	ReleaseBuffers();
 }
 
 void Mesh::Clear()
@@ -15,6 +28,22 @@ void Mesh::Clear()
 	vertices.clear();
 	normals.clear();
 	uvs.clear();
+	indices.clear();
+	indices16.clear();
+	bounds_min = bounds_max = Vector3();
+	buffers_dirty = true;
+}
+
+void Mesh::Swap(Mesh& other)
+{
+	vertices.swap(other.vertices);
+	normals.swap(other.normals);
+	uvs.swap(other.uvs);
+	indices.swap(other.indices);
+	indices16.swap(other.indices16);
+	std::swap(bounds_min, other.bounds_min);
+	std::swap(bounds_max, other.bounds_max);
+	buffers_dirty = other.buffers_dirty = true;
 }
 
 void Mesh::Render(int primitive)
@@ -22,6 +51,13 @@ void Mesh::Render(int primitive)
 	// Render the mesh using your rasterizer
 	assert(vertices.size() && "No vertices in this mesh");
 
+	// Buffer objects need GL 1.5
+	if (use_buffers && glGenBuffers)
+	{
+		RenderBuffers(primitive);
+		return;
+	}
+
 	glEnableClientState(GL_VERTEX_ARRAY);
 	glVertexPointer(3, GL_FLOAT, 0, &vertices[0]);
 
@@ -37,7 +73,12 @@ void Mesh::Render(int primitive)
 		glTexCoordPointer(2, GL_FLOAT, 0, &uvs[0]);
 	}
 
-	glDrawArrays(primitive, 0, static_cast<GLsizei>(vertices.size()));
+	if (indices16.size())
+		glDrawElements(primitive, static_cast<GLsizei>(indices16.size()), GL_UNSIGNED_SHORT, &indices16[0]);
+	else if (indices.size())
+		glDrawElements(primitive, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, &indices[0]);
+	else
+		glDrawArrays(primitive, 0, static_cast<GLsizei>(vertices.size()));
 	glDisableClientState(GL_VERTEX_ARRAY);
 
 	if (normals.size())
@@ -46,11 +87,196 @@ void Mesh::Render(int primitive)
 		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 }
 
+void Mesh::UseBuffers(bool enable, bool interleaved)
+{
+	if (enable && this->interleaved != interleaved)
+		buffers_dirty = true;
+	use_buffers = enable;
+	this->interleaved = interleaved;
+	if (!enable)
+		ReleaseBuffers();
+}
+
+void Mesh::Upload()
+{
+	if (vertices.empty() || !glGenBuffers)
+		return;
+
+	const GLsizeiptr num_vertices = (GLsizeiptr)vertices.size();
+	if (!vertices_vbo)
+		glGenBuffers(1, &vertices_vbo);
+
+	if (interleaved)
+	{
+		// Position, normal and uv of every vertex one after the other (only the attributes the mesh has)
+		const size_t num_floats = 3 + (normals.size() ? 3 : 0) + (uvs.size() ? 2 : 0);
+		std::vector<float> data(vertices.size() * num_floats);
+		float* out = data.data();
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			memcpy(out, &vertices[i], sizeof(Vector3)); out += 3;
+			if (normals.size()) { memcpy(out, &normals[i], sizeof(Vector3)); out += 3; }
+			if (uvs.size()) { memcpy(out, &uvs[i], sizeof(Vector2)); out += 2; }
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo);
+		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+
+		if (normals_vbo) glDeleteBuffers(1, &normals_vbo);
+		if (uvs_vbo) glDeleteBuffers(1, &uvs_vbo);
+		normals_vbo = uvs_vbo = 0;
+	}
+	else
+	{
+		// One buffer per attribute
+		glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo);
+		glBufferData(GL_ARRAY_BUFFER, num_vertices * sizeof(Vector3), vertices.data(), GL_STATIC_DRAW);
+
+		if (normals.size())
+		{
+			if (!normals_vbo) glGenBuffers(1, &normals_vbo);
+			glBindBuffer(GL_ARRAY_BUFFER, normals_vbo);
+			glBufferData(GL_ARRAY_BUFFER, num_vertices * sizeof(Vector3), normals.data(), GL_STATIC_DRAW);
+		}
+		else if (normals_vbo)
+		{
+			glDeleteBuffers(1, &normals_vbo);
+			normals_vbo = 0;
+		}
+
+		if (uvs.size())
+		{
+			if (!uvs_vbo) glGenBuffers(1, &uvs_vbo);
+			glBindBuffer(GL_ARRAY_BUFFER, uvs_vbo);
+			glBufferData(GL_ARRAY_BUFFER, num_vertices * sizeof(Vector2), uvs.data(), GL_STATIC_DRAW);
+		}
+		else if (uvs_vbo)
+		{
+			glDeleteBuffers(1, &uvs_vbo);
+			uvs_vbo = 0;
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (indices.size())
+	{
+		if (!indices_vbo)
+			glGenBuffers(1, &indices_vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo);
+		if (indices16.size())
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices16.size() * sizeof(unsigned short), indices16.data(), GL_STATIC_DRAW);
+		else
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	else if (indices_vbo)
+	{
+		glDeleteBuffers(1, &indices_vbo);
+		indices_vbo = 0;
+	}
+
+	// The vertex array object stores the pointers and the index buffer, so drawing is a single bind
+	if (glGenVertexArrays)
+	{
+		if (!vao)
+			glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		BindAttributes();
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	buffers_dirty = false;
+}
+
+void Mesh::ReleaseBuffers()
+{
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+	GLuint buffers[4] = { vertices_vbo, normals_vbo, uvs_vbo, indices_vbo };
+	for (GLuint buffer : buffers)
+		if (buffer)
+			glDeleteBuffers(1, &buffer);
+
+	vertices_vbo = normals_vbo = uvs_vbo = indices_vbo = 0;
+	vao = 0;
+	buffers_dirty = true;
+}
+
+// Enables the fixed function arrays pointing to the buffers (the offsets are relative to the bound buffer)
+void Mesh::BindAttributes()
+{
+	const bool has_normals = normals.size() > 0;
+	const bool has_uvs = uvs.size() > 0;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	if (has_normals) glEnableClientState(GL_NORMAL_ARRAY);
+	else glDisableClientState(GL_NORMAL_ARRAY);
+	if (has_uvs) glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	else glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	if (interleaved)
+	{
+		GLsizei stride = (GLsizei)((3 + (has_normals ? 3 : 0) + (has_uvs ? 2 : 0)) * sizeof(float));
+		glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo);
+		glVertexPointer(3, GL_FLOAT, stride, (const void*)0);
+		if (has_normals) glNormalPointer(GL_FLOAT, stride, (const void*)(3 * sizeof(float)));
+		if (has_uvs) glTexCoordPointer(2, GL_FLOAT, stride, (const void*)((has_normals ? 6 : 3) * sizeof(float)));
+	}
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo);
+		glVertexPointer(3, GL_FLOAT, 0, (const void*)0);
+		if (has_normals)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, normals_vbo);
+			glNormalPointer(GL_FLOAT, 0, (const void*)0);
+		}
+		if (has_uvs)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, uvs_vbo);
+			glTexCoordPointer(2, GL_FLOAT, 0, (const void*)0);
+		}
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo);
+}
+
+void Mesh::RenderBuffers(int primitive)
+{
+	if (buffers_dirty || !vertices_vbo)
+		Upload();
+
+	if (vao)
+		glBindVertexArray(vao);
+	else
+		BindAttributes();
+
+	if (indices16.size())
+		glDrawElements(primitive, static_cast<GLsizei>(indices16.size()), GL_UNSIGNED_SHORT, (const void*)0);
+	else if (indices.size())
+		glDrawElements(primitive, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, (const void*)0);
+	else
+		glDrawArrays(primitive, 0, static_cast<GLsizei>(vertices.size()));
+
+	// Leave the state as the client arrays path expects it
+	if (vao)
+	{
+		glBindVertexArray(0);
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
 void Mesh::CreateQuad()
 {
-	vertices.clear();
-	normals.clear();
-	uvs.clear();
+	Clear();
 
 	// Create six vertices (3 for upperleft triangle and 3 for lowerright)
 	vertices.push_back(Vector3(1, 1, 0));
@@ -71,9 +297,7 @@ void Mesh::CreateQuad()
 
 void Mesh::CreatePlane(float size)
 {
-	vertices.clear();
-	normals.clear();
-	uvs.clear();
+	Clear();
 
 	// Create six vertices (3 for upperleft triangle and 3 for lowerright)
 
@@ -103,9 +327,7 @@ void Mesh::CreatePlane(float size)
 
 void Mesh::CreateCube(float size)
 {
-	vertices.clear();
-	normals.clear();
-	uvs.clear();
+	Clear();
 
 	
 	vertices.push_back(Vector3(size,  size, size));
@@ -238,111 +460,699 @@ void Mesh::CreateCube(float size)
 	uvs.push_back(Vector2(0, 0));
 }
 
-bool Mesh::LoadOBJ(const char* filename)
+// Parsing helpers for LoadOBJ, they work in place over the mapped file and never allocate
+
+// Approximate size of the ranges of lines parsed by every task
+#define OBJ_CHUNK_SIZE (128 * 1024)
+
+static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+static inline const char* skipSpaces(const char* p, const char* end) { while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p; return p; }
+
+static const char* parseInt(const char* p, const char* end, int& out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) { negative = *p == '-'; ++p; }
+	int value = 0;
+	while (p < end && isDigit(*p)) value = value * 10 + (*p++ - '0');
+	out = negative ? -value : value;
+	return p;
+}
+
+static const char* parseFloat(const char* p, const char* end, float& out)
+{
+	static const double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	p = skipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) { negative = *p == '-'; ++p; }
+
+	// Accumulate all the digits as an integer and remember where the decimal point was
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	int num_digits = 0;
+	for (; p < end && isDigit(*p); ++p)
+		if (num_digits++ < 19) mantissa = mantissa * 10 + (*p - '0'); else exponent++;
+	if (p < end && *p == '.')
+		for (++p; p < end && isDigit(*p); ++p)
+			if (num_digits++ < 19) { mantissa = mantissa * 10 + (*p - '0'); exponent--; }
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		int e = 0;
+		p = parseInt(p + 1, end, e);
+		exponent += e;
+	}
+
+	double value = (double)mantissa;
+	if (exponent < 0)
+		value = exponent >= -22 ? value / powers_of_ten[-exponent] : value * pow(10.0, exponent);
+	else if (exponent > 0)
+		value = exponent <= 22 ? value * powers_of_ten[exponent] : value * pow(10.0, exponent);
+
+	out = (float)(negative ? -value : value);
+	return p;
+}
+
+// Index triplet of a face corner as written in the file (0 when missing, negative when relative)
+struct OBJCorner
+{
+	int v, vt, vn;
+};
+
+struct OBJFace
+{
+	unsigned int first_corner;
+	unsigned int num_corners;
+	unsigned int num_v, num_vt, num_vn; // Elements already read in the chunk, to resolve relative indices
+};
+
+// Everything parsed from one range of lines of the file
+struct OBJChunk
+{
+	const char* begin;
+	const char* end;
+
+	std::vector<Vector3> positions;
+	std::vector<Vector3> normals;
+	std::vector<Vector2> uvs;
+	std::vector<OBJCorner> corners;
+	std::vector<OBJFace> faces;
+
+	unsigned int num_triangles;
+	unsigned int base_v, base_vt, base_vn; // Elements declared in the previous chunks
+	unsigned int first_triangle;
+
+	void Parse();
+};
+
+void OBJChunk::Parse()
+{
+	num_triangles = 0;
+
+	const char* p = begin;
+	while (p < end)
+	{
+		const char* line_end = (const char*)memchr(p, '\n', end - p);
+		if (line_end == NULL)
+			line_end = end;
+
+		p = skipSpaces(p, line_end);
+		if (line_end - p >= 2 && p[0] == 'v' && p[1] == ' ')
+		{
+			Vector3 v;
+			p = parseFloat(p + 2, line_end, v.x);
+			p = parseFloat(p, line_end, v.y);
+			parseFloat(p, line_end, v.z);
+			positions.push_back(v);
+		}
+		else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 't' && p[2] == ' ')
+		{
+			Vector2 v;
+			p = parseFloat(p + 3, line_end, v.x);
+			parseFloat(p, line_end, v.y);
+			uvs.push_back(v);
+		}
+		else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ')
+		{
+			Vector3 v;
+			p = parseFloat(p + 3, line_end, v.x);
+			p = parseFloat(p, line_end, v.y);
+			parseFloat(p, line_end, v.z);
+			normals.push_back(v);
+		}
+		else if (line_end - p >= 2 && p[0] == 'f' && p[1] == ' ')
+		{
+			OBJFace face;
+			face.first_corner = (unsigned int)corners.size();
+			face.num_v = (unsigned int)positions.size();
+			face.num_vt = (unsigned int)uvs.size();
+			face.num_vn = (unsigned int)normals.size();
+
+			// Corners with the format v, v/vt, v//vn or v/vt/vn
+			p = skipSpaces(p + 2, line_end);
+			while (p < line_end)
+			{
+				OBJCorner corner = { 0, 0, 0 };
+				p = parseInt(p, line_end, corner.v);
+				if (p < line_end && *p == '/')
+				{
+					if (++p < line_end && *p != '/')
+						p = parseInt(p, line_end, corner.vt);
+					if (p < line_end && *p == '/')
+						p = parseInt(p + 1, line_end, corner.vn);
+				}
+				if (corner.v == 0)
+					break; // Not an index, ignore the rest of the line
+				corners.push_back(corner);
+				p = skipSpaces(p, line_end);
+			}
+
+			face.num_corners = (unsigned int)corners.size() - face.first_corner;
+			if (face.num_corners >= 3)
+			{
+				faces.push_back(face);
+				num_triangles += face.num_corners - 2;
+			}
+			else
+				corners.resize(face.first_corner);
+		}
+
+		p = line_end + 1;
+	}
+}
+
+// Converts an OBJ index (1 based or negative relative) to a 0 based index in the merged arrays
+static inline int resolveIndex(int index, unsigned int base, unsigned int num_before)
+{
+	return index > 0 ? index - 1 : (int)(base + num_before) + index;
+}
+
+// Finds the corners that share the same index triplet using an open addressing hash table
+// Fills the index buffer (one entry per corner) and the first corner of every unique vertex
+static void weldCorners(const std::vector<OBJCorner>& corners, std::vector<unsigned int>& indices, std::vector<int>& unique_corners)
 {
-	struct stat stbuffer;
-	std::cout << "Loading mesh: " << filename << std::endl;
+	size_t capacity = 16;
+	while (capacity < corners.size() * 2)
+		capacity <<= 1;
 
+	std::vector<int> table(capacity, -1); // Vertex stored in each slot
+	indices.resize(corners.size());
+	unique_corners.clear();
+
+	for (size_t i = 0; i < corners.size(); ++i)
+	{
+		const OBJCorner& c = corners[i];
+		unsigned int hash = ((unsigned int)c.v * 73856093u) ^ ((unsigned int)c.vt * 19349663u) ^ ((unsigned int)c.vn * 83492791u);
+		size_t slot = hash & (capacity - 1);
+
+		while (true)
+		{
+			int vertex = table[slot];
+			if (vertex < 0)
+			{
+				table[slot] = (int)unique_corners.size();
+				indices[i] = (unsigned int)unique_corners.size();
+				unique_corners.push_back((int)i);
+				break;
+			}
+
+			const OBJCorner& other = corners[unique_corners[vertex]];
+			if (other.v == c.v && other.vt == c.vt && other.vn == c.vn)
+			{
+				indices[i] = (unsigned int)vertex;
+				break;
+			}
+			slot = (slot + 1) & (capacity - 1);
+		}
+	}
+}
+
+// Binary mesh cache: a header followed by the vertex, normal, uv and index arrays
+// Every array starts at a multiple of MESH_CACHE_ALIGNMENT so it can be read directly from the mapping
+
+#define MESH_CACHE_MAGIC 0x4853454D // "MESH"
+#define MESH_CACHE_VERSION 1
+#define MESH_CACHE_ALIGNMENT 16
+#define MESH_CACHE_ENDIAN_TAG 0x01020304
+
+struct MeshCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int endian_tag;	// Files written by a machine with another byte order are rejected
+	unsigned int flags;			// Unused, always 0
+
+	unsigned long long source_size;
+	long long source_time;
+
+	float bounds_min[3];
+	float bounds_max[3];
+
+	unsigned int num_vertices;
+	unsigned int num_normals;
+	unsigned int num_uvs;
+	unsigned int num_indices;
+
+	// Byte offsets from the start of the file
+	unsigned long long vertices_offset;
+	unsigned long long normals_offset;
+	unsigned long long uvs_offset;
+	unsigned long long indices_offset;
+	unsigned long long file_size;
+};
+
+static std::string getMeshCachePath(const std::string& obj_path)
+{
+	size_t dot = obj_path.find_last_of('.');
+	size_t slash = obj_path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return obj_path + ".mesh";
+	return obj_path.substr(0, dot) + ".mesh";
+}
+
+static inline unsigned long long alignOffset(unsigned long long offset)
+{
+	return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(unsigned long long)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// Checks that an array of the header fits inside the file
+static bool isBlobValid(const MeshCacheHeader& header, unsigned long long offset, unsigned int count, size_t element_size)
+{
+	if (count == 0)
+		return true;
+	if (offset % MESH_CACHE_ALIGNMENT != 0 || offset < sizeof(MeshCacheHeader))
+		return false;
+	return offset <= header.file_size && (unsigned long long)count * element_size <= header.file_size - offset;
+}
+
+bool Mesh::LoadOBJ(const char* filename, bool use_cache)
+{
 	std::string relPath = absResPath(filename);
 
-	FILE* f = fopen(relPath.c_str(), "rb");
-	if (f == NULL)
+	// The binary version is only valid while the OBJ has the same size and modification time
+	struct stat source_stat;
+	bool has_stat = use_cache && stat(relPath.c_str(), &source_stat) == 0;
+	std::string cache_path = getMeshCachePath(relPath);
+	if (has_stat && LoadBinaryCache(cache_path, (unsigned long long)source_stat.st_size, (long long)source_stat.st_mtime))
+		return true;
+
+	MappedFile file;
+	if (!file.Open(relPath))
 	{
 		std::cerr << "File not found: " << filename << std::endl;
 		return false;
 	}
 
-	stat(relPath.c_str(), &stbuffer);
+	const char* data = file.GetData();
+	const char* data_end = data + file.GetSize();
 
-	unsigned int size = stbuffer.st_size;
-	char* data = new char[size + 1];
-	fread(data, size, 1, f);
-	fclose(f);
-	data[size] = 0;
+	// 1) SPLIT the file in chunks that always end at the end of a line
+	std::vector<OBJChunk> chunks;
+	const char* pos = data;
+	while (pos < data_end)
+	{
+		const char* chunk_end = data_end - pos > OBJ_CHUNK_SIZE ? pos + OBJ_CHUNK_SIZE : data_end;
+		const char* new_line = (const char*)memchr(chunk_end - 1, '\n', data_end - chunk_end + 1);
+		chunk_end = new_line ? new_line + 1 : data_end;
 
-	char* pos = data;
-	char line[255];
-	int i = 0;
+		OBJChunk chunk;
+		chunk.begin = pos;
+		chunk.end = chunk_end;
+		chunks.push_back(chunk);
+		pos = chunk_end;
+	}
+
+	// 2) PARSE every chunk in parallel
+	parallelFor((int)chunks.size(), [&](int i) {
+		chunks[i].Parse();
+	});
 
+	// 3) MERGE the attributes and compute where the triangles of every chunk go
 	std::vector<Vector3> indexed_positions;
 	std::vector<Vector3> indexed_normals;
 	std::vector<Vector2> indexed_uvs;
+	unsigned int num_triangles = 0;
 
-	const float max_float = 10000000;
-	const float min_float = -10000000;
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		OBJChunk& chunk = chunks[i];
+		chunk.base_v = (unsigned int)indexed_positions.size();
+		chunk.base_vt = (unsigned int)indexed_uvs.size();
+		chunk.base_vn = (unsigned int)indexed_normals.size();
+		chunk.first_triangle = num_triangles;
+		num_triangles += chunk.num_triangles;
+
+		indexed_positions.insert(indexed_positions.end(), chunk.positions.begin(), chunk.positions.end());
+		indexed_uvs.insert(indexed_uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+		indexed_normals.insert(indexed_normals.end(), chunk.normals.begin(), chunk.normals.end());
+	}
 
-	unsigned int vertex_i = 0;
+	// 4) TRIANGULATE the faces (as fans) in parallel resolving the indices, every chunk writes its own range
+	std::vector<OBJCorner> triangle_corners(num_triangles * 3);
+	parallelFor((int)chunks.size(), [&](int i) {
+		const OBJChunk& chunk = chunks[i];
+		OBJCorner* out = triangle_corners.data() + chunk.first_triangle * 3;
 
-	//parse file
-	while (*pos != 0)
+		for (size_t f = 0; f < chunk.faces.size(); ++f)
+		{
+			const OBJFace& face = chunk.faces[f];
+			const OBJCorner* corners = &chunk.corners[face.first_corner];
+
+			for (unsigned int k = 1; k + 1 < face.num_corners; ++k)
+			{
+				const OBJCorner* triangle[3] = { &corners[0], &corners[k], &corners[k + 1] };
+				for (int j = 0; j < 3; ++j, ++out)
+				{
+					// 0 based indices, -1 when missing or out of range
+					const OBJCorner& c = *triangle[j];
+					int v = resolveIndex(c.v, chunk.base_v, face.num_v);
+					int vt = c.vt ? resolveIndex(c.vt, chunk.base_vt, face.num_vt) : -1;
+					int vn = c.vn ? resolveIndex(c.vn, chunk.base_vn, face.num_vn) : -1;
+					out->v = v < (int)indexed_positions.size() ? v : -1;
+					out->vt = vt < (int)indexed_uvs.size() ? vt : -1;
+					out->vn = vn < (int)indexed_normals.size() ? vn : -1;
+				}
+			}
+		}
+	});
+
+	// 5) WELD the corners with the same position/uv/normal into a single vertex
+	Clear();
+	bool has_uvs = !indexed_uvs.empty();
+	bool has_normals = !indexed_normals.empty();
+
+	std::vector<int> unique_corners;
+	weldCorners(triangle_corners, indices, unique_corners);
+
+	size_t num_vertices = unique_corners.size();
+	vertices.resize(num_vertices);
+	if (has_uvs) uvs.resize(num_vertices);
+	if (has_normals) normals.resize(num_vertices);
+
+	for (size_t i = 0; i < num_vertices; ++i)
 	{
-		if (*pos == '\n') pos++;
-		if (*pos == '\r') pos++;
+		const OBJCorner& c = triangle_corners[unique_corners[i]];
+		vertices[i] = c.v >= 0 ? indexed_positions[c.v] : Vector3();
+		if (has_uvs) uvs[i] = c.vt >= 0 ? indexed_uvs[c.vt] : Vector2();
+		if (has_normals) normals[i] = c.vn >= 0 ? indexed_normals[c.vn] : Vector3();
+	}
 
-		//read one line
-		i = 0;
-		while (i < 255 && pos[i] != '\n' && pos[i] != '\r' && pos[i] != 0) i++;
-		std::memcpy(line, pos, i);
-		line[i] = 0;
-		pos = pos + i;
+	// 6) OPTIMIZE the order of the triangles for the vertex cache
+	OptimizeVertexCache();
+	UpdateBounds();
 
-		//std::cout << "Line: \"" << line << "\"" << std::endl;
-		if (*line == '#' || *line == 0) continue; //comment
+	// 7) SAVE the result so the next runs skip all the work above
+	if (has_stat && !SaveBinaryCache(cache_path, (unsigned long long)source_stat.st_size, (long long)source_stat.st_mtime))
+		std::cerr << "Could not write the mesh cache: " << cache_path << std::endl;
 
-		//tokenize line
-		std::vector<std::string> tokens = tokenize(line, " ");
+	return true;
+}
+
+bool Mesh::LoadBinaryCache(const std::string& path, unsigned long long source_size, long long source_time)
+{
+	MappedFile file;
+	if (!file.Open(path) || file.GetSize() < sizeof(MeshCacheHeader))
+		return false;
+
+	const char* data = file.GetData();
+	MeshCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.endian_tag != MESH_CACHE_ENDIAN_TAG)
+		return false;
+	if (header.source_size != source_size || header.source_time != source_time)
+		return false; // The OBJ changed since the cache was written
+	if (header.file_size != file.GetSize() || header.num_vertices == 0 || header.num_indices % 3 != 0)
+		return false;
+	if ((header.num_normals && header.num_normals != header.num_vertices) || (header.num_uvs && header.num_uvs != header.num_vertices))
+		return false;
+	if (!isBlobValid(header, header.vertices_offset, header.num_vertices, sizeof(Vector3)) ||
+		!isBlobValid(header, header.normals_offset, header.num_normals, sizeof(Vector3)) ||
+		!isBlobValid(header, header.uvs_offset, header.num_uvs, sizeof(Vector2)) ||
+		!isBlobValid(header, header.indices_offset, header.num_indices, sizeof(unsigned int)))
+		return false;
 
-		if (tokens.empty()) continue;
+	// One bulk copy per array straight from the mapped pages, there is nothing to parse
+	Clear();
+	const Vector3* file_vertices = (const Vector3*)(data + header.vertices_offset);
+	const Vector3* file_normals = (const Vector3*)(data + header.normals_offset);
+	const Vector2* file_uvs = (const Vector2*)(data + header.uvs_offset);
+	const unsigned int* file_indices = (const unsigned int*)(data + header.indices_offset);
+	vertices.assign(file_vertices, file_vertices + header.num_vertices);
+	normals.assign(file_normals, file_normals + header.num_normals);
+	uvs.assign(file_uvs, file_uvs + header.num_uvs);
+	indices.assign(file_indices, file_indices + header.num_indices);
 
-		if (tokens[0] == "v" && tokens.size() == 4)
+	// Reject indices out of range so a damaged file can not make the renderer read out of bounds
+	for (unsigned int index : indices)
+		if (index >= header.num_vertices)
 		{
-			Vector3 v(std::stof(tokens[1].c_str()), std::stof(tokens[2].c_str()), std::stof(tokens[3].c_str()));
-			indexed_positions.push_back(v);
+			Clear();
+			return false;
 		}
-		else if (tokens[0] == "vt" && (tokens.size() == 4 || tokens.size() == 3))
+
+	bounds_min.Set(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+	bounds_max.Set(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+	UpdateIndices16();
+	return true;
+}
+
+bool Mesh::SaveBinaryCache(const std::string& path, unsigned long long source_size, long long source_time)
+{
+	if (vertices.empty() || !IsIndexed())
+		return false;
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = MESH_CACHE_VERSION;
+	header.endian_tag = MESH_CACHE_ENDIAN_TAG;
+	header.source_size = source_size;
+	header.source_time = source_time;
+	header.bounds_min[0] = bounds_min.x; header.bounds_min[1] = bounds_min.y; header.bounds_min[2] = bounds_min.z;
+	header.bounds_max[0] = bounds_max.x; header.bounds_max[1] = bounds_max.y; header.bounds_max[2] = bounds_max.z;
+	header.num_vertices = (unsigned int)vertices.size();
+	header.num_normals = (unsigned int)normals.size();
+	header.num_uvs = (unsigned int)uvs.size();
+	header.num_indices = (unsigned int)indices.size();
+
+	unsigned long long offset = sizeof(MeshCacheHeader);
+	header.vertices_offset = offset = alignOffset(offset);
+	offset += vertices.size() * sizeof(Vector3);
+	header.normals_offset = offset = alignOffset(offset);
+	offset += normals.size() * sizeof(Vector3);
+	header.uvs_offset = offset = alignOffset(offset);
+	offset += uvs.size() * sizeof(Vector2);
+	header.indices_offset = offset = alignOffset(offset);
+	offset += indices.size() * sizeof(unsigned int);
+	header.file_size = offset;
+
+	FILE* f = fopen(path.c_str(), "wb");
+	if (!f)
+		return false;
+
+	// The magic is written at the end so a file left half written is never accepted
+	static const char padding[MESH_CACHE_ALIGNMENT] = { 0 };
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	auto writeBlob = [&](unsigned long long blob_offset, const void* blob, size_t blob_size) {
+		long position = ftell(f);
+		if (ok && position >= 0 && (unsigned long long)position < blob_offset)
+			ok = fwrite(padding, (size_t)(blob_offset - position), 1, f) == 1;
+		if (ok && blob_size)
+			ok = fwrite(blob, blob_size, 1, f) == 1;
+	};
+	writeBlob(header.vertices_offset, vertices.data(), vertices.size() * sizeof(Vector3));
+	writeBlob(header.normals_offset, normals.data(), normals.size() * sizeof(Vector3));
+	writeBlob(header.uvs_offset, uvs.data(), uvs.size() * sizeof(Vector2));
+	writeBlob(header.indices_offset, indices.data(), indices.size() * sizeof(unsigned int));
+
+	if (ok)
+	{
+		unsigned int magic = MESH_CACHE_MAGIC;
+		ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(&magic, sizeof(magic), 1, f) == 1;
+	}
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok)
+		remove(path.c_str());
+	return ok;
+}
+
+void Mesh::UpdateBounds()
+{
+	if (vertices.empty())
+	{
+		bounds_min = bounds_max = Vector3();
+		return;
+	}
+
+	bounds_min = bounds_max = vertices[0];
+	for (const Vector3& v : vertices)
+	{
+		bounds_min.Set(std::min(bounds_min.x, v.x), std::min(bounds_min.y, v.y), std::min(bounds_min.z, v.z));
+		bounds_max.Set(std::max(bounds_max.x, v.x), std::max(bounds_max.y, v.y), std::max(bounds_max.z, v.z));
+	}
+}
+
+// Post-transform vertex cache optimization (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation")
+
+#define VERTEX_CACHE_SIZE 32
+
+// Score of a vertex given its position in the simulated LRU cache (-1 if not there) and the triangles that still use it
+static float vertexCacheScore(int cache_position, unsigned int remaining_triangles)
+{
+	// The terms only depend on small integers, compute them once
+	// A local static is built by the first caller while the others wait (meshes are optimized on several threads)
+	struct ScoreTables
+	{
+		float position_scores[VERTEX_CACHE_SIZE];
+		float valence_scores[64];
+
+		ScoreTables()
 		{
-			Vector2 v(std::stof(tokens[1].c_str()), std::stof(tokens[2].c_str()));
-			indexed_uvs.push_back(v);
+			for (int i = 0; i < VERTEX_CACHE_SIZE; ++i)
+				position_scores[i] = i < 3 ? 0.75f : powf(1.0f - (i - 3) / (float)(VERTEX_CACHE_SIZE - 3), 1.5f); // Used by the last triangle, do not favour it too much
+			valence_scores[0] = 0.0f;
+			for (int i = 1; i < 64; ++i)
+				valence_scores[i] = 2.0f / sqrtf((float)i);
 		}
-		else if (tokens[0] == "vn" && tokens.size() == 4)
+	};
+	static const ScoreTables tables;
+
+	if (remaining_triangles == 0)
+		return -1.0f;
+
+	// Boost the vertices with few triangles left so they are finished early
+	float score = remaining_triangles < 64 ? tables.valence_scores[remaining_triangles] : 2.0f / sqrtf((float)remaining_triangles);
+	if (cache_position >= 0)
+		score += tables.position_scores[cache_position];
+	return score;
+}
+
+static void optimizeVertexCache(unsigned int* indices, size_t num_indices, size_t num_vertices)
+{
+	size_t num_triangles = num_indices / 3;
+	if (num_triangles == 0)
+		return;
+
+	// Triangles not emitted yet that use every vertex
+	std::vector<unsigned int> remaining(num_vertices, 0);
+	for (size_t i = 0; i < num_indices; ++i)
+		remaining[indices[i]]++;
+
+	std::vector<unsigned int> offsets(num_vertices + 1, 0);
+	for (size_t v = 0; v < num_vertices; ++v)
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<unsigned int> vertex_triangles(num_indices);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < num_indices; ++i)
+		vertex_triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<float> vertex_score(num_vertices);
+	for (size_t v = 0; v < num_vertices; ++v)
+		vertex_score[v] = vertexCacheScore(-1, remaining[v]);
+
+	std::vector<float> triangle_score(num_triangles);
+	std::vector<bool> emitted(num_triangles, false);
+	for (size_t t = 0; t < num_triangles; ++t)
+		triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+
+	std::vector<unsigned int> output;
+	output.reserve(num_indices);
+
+	int cache[VERTEX_CACHE_SIZE + 3];
+	int cache_size = 0;
+	size_t scan_position = 0;
+	int best = -1;
+
+	while (output.size() < num_indices)
+	{
+		// No candidate around the cache (dead end), restart from the first triangle not emitted yet
+		if (best < 0)
 		{
-			Vector3 v(std::stof(tokens[1].c_str()), std::stof(tokens[2].c_str()), std::stof(tokens[3].c_str()));
-			indexed_normals.push_back(v);
+			while (emitted[scan_position])
+				scan_position++;
+			best = (int)scan_position;
 		}
-		else if (tokens[0] == "f" && tokens.size() >= 4)
+
+		// Emit it and move its vertices to the front of the cache
+		emitted[best] = true;
+		int new_cache[VERTEX_CACHE_SIZE + 3];
+		int new_size = 0;
+		for (int k = 0; k < 3; ++k)
 		{
-			Vector3 v1, v2, v3;
-			v1 = parseVector3(tokens[1].c_str(), '/');
+			unsigned int v = indices[best * 3 + k];
+			output.push_back(v);
+			remaining[v]--;
 
-			for (size_t iPoly = 2; iPoly < tokens.size() - 1; iPoly++)
-			{
-				v2 = parseVector3(tokens[iPoly].c_str(), '/');
-				v3 = parseVector3(tokens[iPoly + 1].c_str(), '/');
+			// Remove the triangle from the list of the vertex
+			unsigned int* tris = &vertex_triangles[offsets[v]];
+			for (unsigned int j = 0; j <= remaining[v]; ++j)
+				if (tris[j] == (unsigned int)best) { std::swap(tris[j], tris[remaining[v]]); break; }
 
-				vertices.push_back(indexed_positions[(unsigned int)(v1.x) - 1]);
-				vertices.push_back(indexed_positions[(unsigned int)(v2.x) - 1]);
-				vertices.push_back(indexed_positions[(unsigned int)(v3.x) - 1]);
-				//triangles.push_back( VECTOR_INDICES_TYPE(vertex_i, vertex_i+1, vertex_i+2) ); //not needed
-				vertex_i += 3;
+			new_cache[new_size++] = (int)v;
+		}
+		for (int k = 0; k < cache_size; ++k)
+		{
+			int v = cache[k];
+			if (v != new_cache[0] && v != new_cache[1] && v != new_cache[2])
+				new_cache[new_size++] = v;
+		}
 
-				if (indexed_uvs.size() > 0)
-				{
-					uvs.push_back(indexed_uvs[(unsigned int)(v1.y) - 1]);
-					uvs.push_back(indexed_uvs[(unsigned int)(v2.y) - 1]);
-					uvs.push_back(indexed_uvs[(unsigned int)(v3.y) - 1]);
-				}
+		// Update the scores of the vertices in the cache (and the ones that just fell out of it)
+		for (int k = 0; k < new_size; ++k)
+		{
+			int v = new_cache[k];
+			vertex_score[v] = vertexCacheScore(k < VERTEX_CACHE_SIZE ? k : -1, remaining[v]);
+		}
 
-				if (indexed_normals.size() > 0)
+		// The next triangle is the best one using a vertex of the cache
+		best = -1;
+		float best_score = -1e30f;
+		for (int k = 0; k < new_size; ++k)
+		{
+			int v = new_cache[k];
+			for (unsigned int j = 0; j < remaining[v]; ++j)
+			{
+				unsigned int t = vertex_triangles[offsets[v] + j];
+				triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+				if (triangle_score[t] > best_score)
 				{
-					normals.push_back(indexed_normals[(unsigned int)(v1.z) - 1]);
-					normals.push_back(indexed_normals[(unsigned int)(v2.z) - 1]);
-					normals.push_back(indexed_normals[(unsigned int)(v3.z) - 1]);
+					best_score = triangle_score[t];
+					best = (int)t;
 				}
 			}
 		}
+
+		cache_size = std::min(new_size, VERTEX_CACHE_SIZE);
+		memcpy(cache, new_cache, cache_size * sizeof(int));
 	}
 
-	delete[] data;
+	memcpy(indices, output.data(), num_indices * sizeof(unsigned int));
+}
 
-	return true;
+void Mesh::OptimizeVertexCache()
+{
+	if (!IsIndexed())
+		return;
+
+	optimizeVertexCache(indices.data(), indices.size(), vertices.size());
+
+	// Renumber the vertices in order of first use so the vertex fetch is sequential too
+	std::vector<int> remap(vertices.size(), -1);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		if (remap[indices[i]] < 0)
+			remap[indices[i]] = (int)next++;
+		indices[i] = (unsigned int)remap[indices[i]];
+	}
+
+	std::vector<Vector3> old_vertices(vertices), old_normals(normals);
+	std::vector<Vector2> old_uvs(uvs);
+	vertices.resize(next);
+	if (normals.size()) normals.resize(next);
+	if (uvs.size()) uvs.resize(next);
+	for (size_t v = 0; v < remap.size(); ++v)
+	{
+		if (remap[v] < 0) continue; // Not used by any triangle
+		vertices[remap[v]] = old_vertices[v];
+		if (normals.size()) normals[remap[v]] = old_normals[v];
+		if (uvs.size()) uvs[remap[v]] = old_uvs[v];
+	}
+
+	UpdateIndices16();
+}
+
+void Mesh::UpdateIndices16()
+{
+	buffers_dirty = true;
+
+	indices16.clear();
+	if (vertices.size() > 65536)
+		return;
+
+	indices16.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); ++i)
+		indices16[i] = (unsigned short)indices[i];
 }
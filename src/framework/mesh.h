@@ -5,29 +5,85 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include "framework.h"
 #include "camera.h"
 #include "main/includes.h"
 
 class Mesh
 {
+	// Vertex attributes, unique vertices when the mesh is indexed
 	std::vector<Vector3> vertices;
 	std::vector<Vector3> normals;
 	std::vector<Vector2> uvs;
 
+	// Triangle list indexing the vertex arrays (empty when the mesh is not indexed)
+	// indices16 is a copy of indices used when every index fits in 16 bits
+	std::vector<unsigned int> indices;
+	std::vector<unsigned short> indices16;
+
+	// Axis aligned bounding box of the vertices
+	Vector3 bounds_min;
+	Vector3 bounds_max;
+
+	// Copy of the arrays in GPU buffer objects (0 when not uploaded)
+	// With the interleaved layout all the attributes of a vertex are stored together in vertices_vbo
+	bool use_buffers;
+	bool interleaved;
+	bool buffers_dirty;			// The CPU arrays changed since the last upload
+	GLuint vertices_vbo;
+	GLuint normals_vbo;
+	GLuint uvs_vbo;
+	GLuint indices_vbo;
+	GLuint vao;					// Remembers the bindings of the buffers (if the driver supports it)
+
+	void UpdateIndices16();
+	void UpdateBounds();
+	void BindAttributes();
+	void RenderBuffers(int primitive);
+
+	// Binary .mesh cache stored next to the OBJ, valid while the OBJ keeps the same size and modification time
+	bool LoadBinaryCache(const std::string& path, unsigned long long source_size, long long source_time);
+	bool SaveBinaryCache(const std::string& path, unsigned long long source_size, long long source_time);
+
+	// Not copyable, the GPU buffers belong to a single mesh
+	Mesh(const Mesh&);
+	Mesh& operator = (const Mesh&);
+
 public:
 
 	Mesh();
+	~Mesh();
 	void Clear();
+
+	// Exchanges the vertex arrays with other, the GPU buffers stay with each mesh and are uploaded again
+	void Swap(Mesh& other);
+
 	void Render(int primitive = GL_TRIANGLES);
 
+	// Renders from buffer objects uploaded once (and again after the arrays change) instead of sending the arrays every draw
+	void UseBuffers(bool enable, bool interleaved = true);
+	void Upload();
+	void ReleaseBuffers();
+
 	void CreatePlane(float size);
 	void CreateCube(float size);
 	void CreateQuad();
 
-	bool LoadOBJ(const char* filename);
+	// Loads an OBJ, unless use_cache is false the binary .mesh version is used (and written) when possible
+	bool LoadOBJ(const char* filename, bool use_cache = true);
+
+	// Reorders the triangles to reuse the post-transform vertex cache (Forsyth) and the vertices in order of use
+	void OptimizeVertexCache();
 
 	const std::vector<Vector3>& GetVertices() { return vertices; }
 	const std::vector<Vector3>& GetNormals() { return normals; }
 	const std::vector<Vector2>& GetUVs() { return uvs; }
+	const std::vector<unsigned int>& GetIndices() { return indices; }
+	const Vector3& GetBoundsMin() const { return bounds_min; }
+	const Vector3& GetBoundsMax() const { return bounds_max; }
+
+	bool IsUsingBuffers() const { return use_buffers; }
+	bool IsIndexed() const { return !indices.empty(); }
+	unsigned int GetTriangleCount() const { return (unsigned int)(IsIndexed() ? indices.size() : vertices.size()) / 3; }
 };
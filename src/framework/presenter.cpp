@@ -0,0 +1,224 @@
+#include "presenter.h"
+#include "image.h"
+#include "shader.h"
+
+Presenter::Presenter()
+{
+	ready = false;
+	shader = NULL;
+	for (int i = 0; i < NUM_BUFFERS; ++i)
+	{
+		buffers[i] = 0;
+		fences[i] = NULL;
+	}
+	current_buffer = 0;
+	width = height = 0;
+	texture_valid = false;
+	uploaded_pixels = 0;
+}
+
+Presenter::~Presenter()
+{
+	for (int i = 0; i < NUM_BUFFERS; ++i)
+		if (fences[i])
+			glDeleteSync(fences[i]);
+	if (buffers[0])
+		glDeleteBuffers(NUM_BUFFERS, buffers);
+	if (texture.texture_id)
+		glDeleteTextures(1, &texture.texture_id);
+}
+
+bool Presenter::Init()
+{
+	// Buffer objects and shaders need GL 2.1, the pixel buffers also need ARB_pixel_buffer_object, ARB_map_buffer_range and ARB_sync
+	if (!GLEW_VERSION_2_1)
+	{
+		std::cerr << "Presenter: GL 2.1 not supported, using glDrawPixels" << std::endl;
+		return false;
+	}
+
+	shader = Shader::Get("shaders/quad.vs", "shaders/quad.fs");
+	if (!shader)
+	{
+		std::cerr << "Presenter: could not load the quad shaders, using glDrawPixels" << std::endl;
+		return false;
+	}
+
+	quad.CreateQuad();
+	quad.UseBuffers(true);
+
+	if (GLEW_ARB_pixel_buffer_object && GLEW_ARB_map_buffer_range && GLEW_ARB_sync)
+		glGenBuffers(NUM_BUFFERS, buffers);
+
+	ready = true;
+	return true;
+}
+
+void Presenter::Resize(unsigned int width, unsigned int height)
+{
+	this->width = width;
+	this->height = height;
+
+	// Storage only, the pixels arrive with the first upload
+	texture.Create(width, height, GL_RGB, GL_UNSIGNED_BYTE, false);
+	texture.Upload(GL_RGB, GL_UNSIGNED_BYTE, false, NULL, GL_RGB8);
+
+	// The image is drawn 1:1, no filtering needed (anisotropic filtering would blend neighbour texels)
+	glBindTexture(GL_TEXTURE_2D, texture.texture_id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// New storage for the buffers, the uploads still pending keep the old one (no need to wait for their fences)
+	if (buffers[0])
+	{
+		for (int i = 0; i < NUM_BUFFERS; ++i)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[i]);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * sizeof(Color), NULL, GL_STREAM_DRAW);
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = NULL;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	Invalidate();
+}
+
+void Presenter::FindChangedRows(const Image& image)
+{
+	const size_t row_size = width * sizeof(Color);
+	const unsigned char* src = (const unsigned char*)image.pixels;
+
+	// Everything after a resize or an Invalidate
+	if (!texture_valid || shadow.size() != row_size * height)
+	{
+		shadow.assign(src, src + row_size * height);
+		regions.push_back(Rect(0, 0, width, height));
+		return;
+	}
+
+	// Runs of consecutive rows that differ from the last upload
+	for (unsigned int y = 0; y < height; ++y)
+	{
+		unsigned char* old_row = &shadow[y * row_size];
+		const unsigned char* new_row = src + y * row_size;
+		if (memcmp(old_row, new_row, row_size) == 0)
+			continue;
+
+		memcpy(old_row, new_row, row_size);
+		if (!regions.empty() && regions.back().y + regions.back().height == (int)y)
+			regions.back().height++;
+		else
+			regions.push_back(Rect(0, y, width, 1));
+	}
+}
+
+void Presenter::UploadRegions(const Image& image)
+{
+	const unsigned char* src = (const unsigned char*)image.pixels;
+	const size_t row_size = width * sizeof(Color);
+
+	uploaded_pixels = 0;
+	for (const Rect& r : regions)
+		uploaded_pixels += r.GetArea();
+	if (uploaded_pixels == 0)
+		return;
+
+	// 1) COPY the areas packed one after the other in the next pixel buffer
+	bool from_buffer = false;
+	if (buffers[0])
+	{
+		current_buffer = (current_buffer + 1) % NUM_BUFFERS;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[current_buffer]);
+
+		// The upload from this buffer NUM_BUFFERS frames ago is normally done, the wait only happens when the GPU is that far behind
+		GLsync& fence = fences[current_buffer];
+		if (fence)
+		{
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(fence);
+			fence = NULL;
+		}
+
+		// Only the bytes of this frame are mapped, unsynchronized: the fence already made sure nothing reads them
+		unsigned char* dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, uploaded_pixels * sizeof(Color),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (dst)
+		{
+			for (const Rect& r : regions)
+			{
+				const size_t span = r.width * sizeof(Color);
+				for (int y = r.y; y < r.y + r.height; ++y, dst += span)
+					memcpy(dst, src + y * row_size + r.x * sizeof(Color), span);
+			}
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			from_buffer = true;
+		}
+		else
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	// 2) UPLOAD every area into the texture, asynchronous when reading from a pixel buffer
+	// Reading from the image the rows are width pixels long, in the pixel buffer they are packed
+	glBindTexture(GL_TEXTURE_2D, texture.texture_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, from_buffer ? 0 : width);
+	size_t offset = 0;
+	for (const Rect& r : regions)
+	{
+		const void* data = from_buffer ? (const void*)offset : (const void*)(src + r.y * row_size + r.x * sizeof(Color));
+		glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, GL_RGB, GL_UNSIGNED_BYTE, data);
+		offset += r.GetArea() * sizeof(Color);
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (from_buffer)
+		fences[current_buffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (buffers[0])
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	texture_valid = true;
+}
+
+void Presenter::Present(const Image& image, const Rect* dirty)
+{
+	// The texture path expects tightly packed RGB pixels
+	if (!ready || image.bytes_per_pixel != 3 || sizeof(Color) != 3 || image.width == 0 || image.height == 0)
+	{
+		const_cast<Image&>(image).Render();
+		return;
+	}
+
+	if (image.width != width || image.height != height)
+		Resize(image.width, image.height);
+
+	regions.clear();
+	if (dirty && texture_valid)
+	{
+		// The row copy would be out of date after uploading only the dirty area
+		shadow.clear();
+		Rect area = dirty->Intersection(Rect(0, 0, width, height));
+		if (!area.IsEmpty())
+			regions.push_back(area);
+	}
+	else
+		FindChangedRows(image);
+	UploadRegions(image);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(0, 0, width, height);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+
+	shader->Enable();
+	shader->SetTexture("u_texture", &texture);
+	quad.Render();
+	shader->Disable();
+
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
@@ -0,0 +1,72 @@
+/*
+	+ The Presenter shows a CPU Image in the window.
+	+ The pixels are streamed into a texture through a ring of pixel buffer objects (so the upload does not stall the CPU)
+	  and drawn with a fullscreen quad using the quad.vs/quad.fs shaders. Only the rows that changed since the last frame are sent.
+	+ When something is not supported it falls back to Image::Render (glDrawPixels).
+*/
+
+#pragma once
+
+#include <vector>
+#include "main/includes.h"
+#include "texture.h"
+#include "mesh.h"
+
+class Image;
+class Shader;
+
+class Presenter
+{
+public:
+	// Pixel buffers in flight, the CPU writes one while the GPU may still be reading the others
+	// Their storage is allocated once per size, a fence tells when the GPU is done with the upload of each one
+	static const int NUM_BUFFERS = 3;
+
+	Presenter();
+	~Presenter();
+
+	// Needs the GL context of the window, returns false if only the glDrawPixels path is available
+	bool Init();
+
+	// Uploads the changed rows of the image and draws it 1:1 from the bottom-left corner of the window
+	// When the caller knows the area that changed (dirty) only that area is uploaded, without comparing rows
+	void Present(const Image& image, const Rect* dirty = NULL);
+
+	// Forces the next Present to upload the whole image
+	void Invalidate() { shadow.clear(); texture_valid = false; }
+
+	// False when Init could not set up the texture, the images are drawn with glDrawPixels
+	bool IsStreaming() const { return ready; }
+
+	// Pixels sent to the GPU by the last Present
+	unsigned int GetUploadedPixels() const { return uploaded_pixels; }
+
+private:
+	// Not copyable, the GL objects belong to a single presenter
+	Presenter(const Presenter&);
+	Presenter& operator = (const Presenter&);
+
+	void Resize(unsigned int width, unsigned int height);
+	void FindChangedRows(const Image& image);
+	void UploadRegions(const Image& image);
+
+	bool ready;
+	Shader* shader;
+	Mesh quad;
+	Texture texture;
+
+	GLuint buffers[NUM_BUFFERS];
+	GLsync fences[NUM_BUFFERS]; // After the last upload from every buffer, NULL when none is pending
+	int current_buffer;
+
+	unsigned int width;
+	unsigned int height;
+
+	// Copy of the last uploaded image, used to find the rows that changed (empty when out of date)
+	std::vector<unsigned char> shadow;
+	bool texture_valid;
+
+	// Areas of the image to upload this frame
+	std::vector<Rect> regions;
+	unsigned int uploaded_pixels;
+};
@@ -0,0 +1,146 @@
+#include "profiler.h"
+#include "image.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// Height of the graph in pixels and milliseconds shown
+#define OVERLAY_HEIGHT 120
+#define OVERLAY_MS 40.0f
+#define OVERLAY_COLUMN_WIDTH 2
+
+Profiler::Profiler()
+{
+	for (int s = 0; s < NUM_STAGES; ++s)
+		current[s] = 0.0f;
+	for (int s = 0; s <= NUM_STAGES; ++s)
+		for (int i = 0; i < HISTORY_SIZE; ++i)
+			samples[s][i] = 0.0f;
+	next_frame = 0;
+	num_frames = 0;
+	frame_start = std::chrono::high_resolution_clock::now();
+}
+
+void Profiler::BeginFrame()
+{
+	frame_start = std::chrono::high_resolution_clock::now();
+	for (int s = 0; s < NUM_STAGES; ++s)
+		current[s] = 0.0f;
+}
+
+void Profiler::EndFrame()
+{
+	for (int s = 0; s < NUM_STAGES; ++s)
+		samples[s][next_frame] = current[s];
+	samples[NUM_STAGES][next_frame] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - frame_start).count();
+
+	next_frame = (next_frame + 1) % HISTORY_SIZE;
+	num_frames = std::min(num_frames + 1, (int)HISTORY_SIZE);
+}
+
+Profiler::Stats Profiler::GetStats(int stage) const
+{
+	Stats stats = { 0.0f, 0.0f, 0.0f };
+	if (num_frames == 0 || stage < 0 || stage > NUM_STAGES)
+		return stats;
+
+	// The first num_frames entries are valid until the ring wraps, then all of them
+	float sorted[HISTORY_SIZE];
+	double sum = 0.0;
+	for (int i = 0; i < num_frames; ++i)
+	{
+		sorted[i] = samples[stage][i];
+		sum += sorted[i];
+	}
+
+	int p99_index = std::min(num_frames - 1, (int)(num_frames * 0.99f));
+	std::nth_element(sorted, sorted + p99_index, sorted + num_frames);
+	stats.p99 = sorted[p99_index];
+	stats.min = *std::min_element(sorted, sorted + num_frames);
+	stats.avg = (float)(sum / num_frames);
+	return stats;
+}
+
+const char* Profiler::GetStageName(int stage)
+{
+	static const char* names[NUM_STAGES + 1] = { "events", "update", "render", "present", "swap", "frame" };
+	return stage >= 0 && stage <= NUM_STAGES ? names[stage] : "";
+}
+
+void Profiler::GetSummary(char* text, size_t size) const
+{
+	size_t length = 0;
+	for (int s = NUM_STAGES; s >= -1 && length < size; --s)
+	{
+		int written;
+		if (s < 0)
+			written = snprintf(text + length, size - length, " ms (min/avg/p99)");
+		else
+		{
+			Stats stats = GetStats(s);
+			written = snprintf(text + length, size - length, "%s%s %.2f/%.2f/%.2f", length ? ", " : "", GetStageName(s), stats.min, stats.avg, stats.p99);
+		}
+		if (written < 0)
+			break;
+		length += written;
+	}
+}
+
+Rect Profiler::DrawOverlay(Image& target, int x, int y) const
+{
+	static const Color stage_colors[NUM_STAGES] = {
+		Color::YELLOW, Color::CYAN, Color::BLUE, Color::PURPLE, Color::GRAY
+	};
+	const Color other_color(64, 64, 64);
+	const float pixels_per_ms = OVERLAY_HEIGHT / OVERLAY_MS;
+
+	const int width = HISTORY_SIZE * OVERLAY_COLUMN_WIDTH;
+	Rect area = Rect(x, y, width, OVERLAY_HEIGHT).Intersection(Rect(0, 0, target.width, target.height));
+	if (area.IsEmpty())
+		return area;
+
+	// Background
+	for (int py = area.y; py < area.y + area.height; ++py)
+		for (int px = area.x; px < area.x + area.width; ++px)
+			target.SetPixelUnsafe(px, py, Color(16, 16, 16));
+
+	auto drawSpan = [&](int column, float from_ms, float to_ms, const Color& c) {
+		int y0 = y + (int)(from_ms * pixels_per_ms);
+		int y1 = std::min(y + (int)(to_ms * pixels_per_ms), y + OVERLAY_HEIGHT);
+		for (int py = std::max(y0, area.y); py < std::min(y1, area.y + area.height); ++py)
+			for (int px = x + column * OVERLAY_COLUMN_WIDTH; px < x + (column + 1) * OVERLAY_COLUMN_WIDTH; ++px)
+				if (px >= area.x && px < area.x + area.width)
+					target.SetPixelUnsafe(px, py, c);
+	};
+
+	// One column per frame, the oldest on the left, with the stages stacked
+	for (int i = 0; i < num_frames; ++i)
+	{
+		int frame = (next_frame - num_frames + i + HISTORY_SIZE) % HISTORY_SIZE;
+		int column = HISTORY_SIZE - num_frames + i;
+
+		float total = 0.0f;
+		for (int s = 0; s < NUM_STAGES; ++s)
+		{
+			drawSpan(column, total, total + samples[s][frame], stage_colors[s]);
+			total += samples[s][frame];
+		}
+		drawSpan(column, total, samples[NUM_STAGES][frame], other_color);
+	}
+
+	// Reference lines
+	Stats frame_stats = GetStats(NUM_STAGES);
+	auto drawLine = [&](float ms, const Color& c) {
+		int py = y + (int)(ms * pixels_per_ms);
+		if (py < area.y || py >= area.y + area.height)
+			return;
+		for (int px = area.x; px < area.x + area.width; ++px)
+			target.SetPixelUnsafe(px, py, c);
+	};
+	drawLine(1000.0f / 60.0f, Color::GREEN);
+	drawLine(frame_stats.avg, Color::WHITE);
+	drawLine(frame_stats.p99, Color::RED);
+
+	target.MarkDirty(area);
+	return area;
+}
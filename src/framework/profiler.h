@@ -0,0 +1,77 @@
+/*
+	+ The Profiler measures how long every stage of the frame takes (with microsecond resolution).
+	+ Wrap the code of a stage with a ScopedTimer, the last HISTORY_SIZE frames are kept to compute min/avg/p99.
+	+ DrawOverlay draws the frame time graph into an Image, every column is a frame with a color per stage:
+	  events (yellow), update (cyan), render (blue), present (purple), swap (gray), and the rest of the frame (dark gray).
+	  The horizontal lines are the 60 fps budget (green), the average (white) and the 99th percentile (red) of the frame time.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <chrono>
+#include "framework.h"
+
+class Image;
+
+class Profiler
+{
+public:
+	enum Stage { STAGE_EVENTS, STAGE_UPDATE, STAGE_RENDER, STAGE_PRESENT, STAGE_SWAP, NUM_STAGES };
+
+	// Frames kept in the ring buffer
+	static const int HISTORY_SIZE = 240;
+
+	// Times in milliseconds
+	struct Stats
+	{
+		float min;
+		float avg;
+		float p99;
+	};
+
+	Profiler();
+
+	void BeginFrame();
+	void EndFrame();
+	void AddSample(Stage stage, float ms) { current[stage] += ms; }
+
+	// Statistics of a stage over the frames in the history (NUM_STAGES for the whole frame)
+	Stats GetStats(int stage) const;
+	// Writes min/avg/p99 of every stage into text (no allocations, it is called while the frame runs)
+	void GetSummary(char* text, size_t size) const;
+
+	// Returns the area of the image written
+	Rect DrawOverlay(Image& target, int x, int y) const;
+
+	static const char* GetStageName(int stage);
+
+private:
+	std::chrono::high_resolution_clock::time_point frame_start;
+	float current[NUM_STAGES];
+
+	// Ring buffer, [stage][frame], the last row is the whole frame
+	float samples[NUM_STAGES + 1][HISTORY_SIZE];
+	int next_frame;
+	int num_frames;
+};
+
+// Adds the time between its construction and destruction (or Stop) to a stage of the profiler
+class ScopedTimer
+{
+public:
+	ScopedTimer(Profiler& profiler, Profiler::Stage stage) : profiler(profiler), stage(stage), running(true) { start = std::chrono::high_resolution_clock::now(); }
+	~ScopedTimer() { Stop(); }
+
+	void Stop() {
+		if (!running) return;
+		profiler.AddSample(stage, std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+		running = false;
+	}
+
+private:
+	Profiler& profiler;
+	Profiler::Stage stage;
+	bool running;
+	std::chrono::high_resolution_clock::time_point start;
+};
@@ -0,0 +1,283 @@
+#include "rasterizer.h"
+#include "image.h"
+#include "utils.h"
+
+// Vertices further than this (in pixels) are clamped so the 64 bits edge setup never overflows
+#define GUARD_BAND 16777216.0f
+
+// Floor and ceil divisions by the subpixel scale that also work for negative values
+static inline int floorFixed(long long v) { return (int)(v >= 0 ? v >> TileRasterizer::SUBPIXEL_BITS : -((-v + (1 << TileRasterizer::SUBPIXEL_BITS) - 1) >> TileRasterizer::SUBPIXEL_BITS)); }
+static inline int ceilFixed(long long v) { return -floorFixed(-v); }
+
+TileRasterizer::TileRasterizer()
+{
+	width = height = 0;
+	tiles_x = tiles_y = 0;
+}
+
+void TileRasterizer::Begin(unsigned int width, unsigned int height)
+{
+	triangles.clear();
+	for (unsigned int t : active_tiles)
+		bins[t].clear();
+	active_tiles.clear();
+	bounds = Rect();
+
+	this->width = width;
+	this->height = height;
+	tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	// Keep the previous bins around so their memory is reused between batches
+	if (bins.size() < (size_t)(tiles_x * tiles_y))
+		bins.resize(tiles_x * tiles_y);
+}
+
+bool TileRasterizer::SetupTriangle(const float* x, const float* y, Triangle& tri)
+{
+	if (width == 0 || height == 0)
+		return false;
+
+	const float scale = (float)(1 << SUBPIXEL_BITS);
+	long long X[3], Y[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		X[i] = (long long)floorf(clamp(x[i], -GUARD_BAND, GUARD_BAND) * scale + 0.5f);
+		Y[i] = (long long)floorf(clamp(y[i], -GUARD_BAND, GUARD_BAND) * scale + 0.5f);
+	}
+
+	// Make the winding consistent so the inside is always the positive side of every edge
+	long long area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+	if (area == 0)
+		return false; // Degenerated triangle
+	if (area < 0)
+	{
+		std::swap(X[1], X[2]);
+		std::swap(Y[1], Y[2]);
+	}
+
+	// Bounding box of the pixel centers covered, clipped to the target
+	const long long half = 1 << (SUBPIXEL_BITS - 1);
+	tri.min_x = std::max(ceilFixed(std::min(X[0], std::min(X[1], X[2])) - half), 0);
+	tri.min_y = std::max(ceilFixed(std::min(Y[0], std::min(Y[1], Y[2])) - half), 0);
+	tri.max_x = std::min(floorFixed(std::max(X[0], std::max(X[1], X[2])) - half), (int)width - 1);
+	tri.max_y = std::min(floorFixed(std::max(Y[0], std::max(Y[1], Y[2])) - half), (int)height - 1);
+	if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+		return false;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		int j = (i + 1) % 3;
+		long long dx = X[j] - X[i];
+		long long dy = Y[j] - Y[i];
+
+		// E(P) = dx * (P.y - Y[i]) - dy * (P.x - X[i]) with P = pixel * 16 + 8 (the pixel center)
+		Edge& e = tri.edges[i];
+		e.a = -dy << SUBPIXEL_BITS;
+		e.b = dx << SUBPIXEL_BITS;
+		e.c = dx * (half - Y[i]) - dy * (half - X[i]);
+
+		// Fill convention: pixels exactly on a shared edge belong to only one of the two triangles
+		if (!(dy > 0 || (dy == 0 && dx > 0)))
+			e.c -= 1;
+	}
+
+	tri.has_depth = false;
+	return true;
+}
+
+void TileRasterizer::BinTriangle(const Triangle& tri)
+{
+	unsigned int index = (unsigned int)triangles.size();
+	triangles.push_back(tri);
+	bounds.Union(Rect(tri.min_x, tri.min_y, tri.max_x - tri.min_x + 1, tri.max_y - tri.min_y + 1));
+
+	// Bin the triangle into every tile touched by its bounding box
+	for (int ty = tri.min_y / TILE_SIZE; ty <= tri.max_y / TILE_SIZE; ++ty)
+		for (int tx = tri.min_x / TILE_SIZE; tx <= tri.max_x / TILE_SIZE; ++tx)
+		{
+			unsigned int t = ty * tiles_x + tx;
+			if (bins[t].empty())
+				active_tiles.push_back(t);
+			bins[t].push_back(index);
+		}
+}
+
+void TileRasterizer::AddTriangle(const Vector2& p0, const Vector2& p1, const Vector2& p2, const Color& c)
+{
+	float x[3] = { p0.x, p1.x, p2.x };
+	float y[3] = { p0.y, p1.y, p2.y };
+
+	Triangle tri;
+	if (!SetupTriangle(x, y, tri))
+		return;
+	tri.color = c;
+	BinTriangle(tri);
+}
+
+void TileRasterizer::AddTriangle(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Color& c0, const Color& c1, const Color& c2)
+{
+	float x[3] = { p0.x, p1.x, p2.x };
+	float y[3] = { p0.y, p1.y, p2.y };
+
+	Triangle tri;
+	if (!SetupTriangle(x, y, tri))
+		return;
+	tri.color = c0;
+	tri.has_depth = true;
+
+	// Gradients of every attribute computed from the snapped vertices (screen space, not perspective corrected)
+	const double scale = 1.0 / (1 << SUBPIXEL_BITS);
+	double sx[3], sy[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		sx[i] = floor(clamp(x[i], -GUARD_BAND, GUARD_BAND) / scale + 0.5) * scale;
+		sy[i] = floor(clamp(y[i], -GUARD_BAND, GUARD_BAND) / scale + 0.5) * scale;
+	}
+	double ex1 = sx[1] - sx[0], ey1 = sy[1] - sy[0];
+	double ex2 = sx[2] - sx[0], ey2 = sy[2] - sy[0];
+	double inv_det = 1.0 / (ex1 * ey2 - ex2 * ey1);
+
+	auto makePlane = [&](float a0, float a1, float a2) {
+		double da1 = a1 - a0, da2 = a2 - a0;
+		double dx = (da1 * ey2 - da2 * ey1) * inv_det;
+		double dy = (da2 * ex1 - da1 * ex2) * inv_det;
+		Plane plane;
+		plane.dx = (float)dx;
+		plane.dy = (float)dy;
+		plane.base = (float)(a0 + dx * (0.5 - sx[0]) + dy * (0.5 - sy[0])); // sampled at pixel centers
+		return plane;
+	};
+
+	tri.z = makePlane(p0.z, p1.z, p2.z);
+	for (int k = 0; k < 3; ++k)
+		tri.rgb[k] = makePlane(c0.v[k], c1.v[k], c2.v[k]);
+
+	BinTriangle(tri);
+}
+
+void TileRasterizer::Flush(Image& target, FloatImage* zbuffer)
+{
+	if (zbuffer && (zbuffer->width != width || zbuffer->height != height))
+		zbuffer = NULL;
+
+	if (target.width == width && target.height == height && !triangles.empty())
+	{
+		// Each tile is owned by a single task so no synchronization is needed between them
+		parallelFor((int)active_tiles.size(), [&](int i) {
+			RasterizeTile(target, zbuffer, active_tiles[i]);
+		});
+		target.MarkDirty(bounds);
+	}
+
+	Begin(width, height);
+}
+
+void TileRasterizer::RasterizeTile(Image& target, FloatImage* zbuffer, unsigned int tile_index)
+{
+	const int tile_x0 = (tile_index % tiles_x) * TILE_SIZE;
+	const int tile_y0 = (tile_index / tiles_x) * TILE_SIZE;
+	const int tile_x1 = std::min(tile_x0 + TILE_SIZE, (int)width) - 1;
+	const int tile_y1 = std::min(tile_y0 + TILE_SIZE, (int)height) - 1;
+
+	const std::vector<unsigned int>& bin = bins[tile_index];
+	for (unsigned int i = 0; i < bin.size(); ++i)
+	{
+		const Triangle& tri = triangles[bin[i]];
+
+		int x0 = std::max(tri.min_x, tile_x0);
+		int y0 = std::max(tri.min_y, tile_y0);
+		int x1 = std::min(tri.max_x, tile_x1);
+		int y1 = std::min(tri.max_y, tile_y1);
+
+		// Test the corners of the rectangle: reject it or fill it entirely without per pixel tests
+		bool covered = true;
+		bool rejected = false;
+		for (int k = 0; k < 3 && !rejected; ++k)
+		{
+			const Edge& e = tri.edges[k];
+			long long c00 = e.Evaluate(x0, y0), c10 = e.Evaluate(x1, y0);
+			long long c01 = e.Evaluate(x0, y1), c11 = e.Evaluate(x1, y1);
+			if ((c00 & c10 & c01 & c11) < 0) rejected = true;
+			if ((c00 | c10 | c01 | c11) < 0) covered = false;
+		}
+		if (rejected)
+			continue;
+
+		if (tri.has_depth)
+		{
+			RasterizeDepthRect(tri, target, zbuffer, x0, y0, x1, y1);
+			continue;
+		}
+
+		if (covered)
+		{
+			for (int y = y0; y <= y1; ++y)
+			{
+				Color* row = target.pixels + y * width;
+				for (int x = x0; x <= x1; ++x)
+					row[x] = tri.color;
+			}
+			continue;
+		}
+
+		const Edge& e0 = tri.edges[0];
+		const Edge& e1 = tri.edges[1];
+		const Edge& e2 = tri.edges[2];
+		long long w0_row = e0.Evaluate(x0, y0);
+		long long w1_row = e1.Evaluate(x0, y0);
+		long long w2_row = e2.Evaluate(x0, y0);
+
+		for (int y = y0; y <= y1; ++y)
+		{
+			Color* row = target.pixels + y * width;
+			long long w0 = w0_row, w1 = w1_row, w2 = w2_row;
+			for (int x = x0; x <= x1; ++x)
+			{
+				// The pixel is inside when the three edge functions are non negative
+				if ((w0 | w1 | w2) >= 0)
+					row[x] = tri.color;
+				w0 += e0.a; w1 += e1.a; w2 += e2.a;
+			}
+			w0_row += e0.b; w1_row += e1.b; w2_row += e2.b;
+		}
+	}
+}
+
+void TileRasterizer::RasterizeDepthRect(const Triangle& tri, Image& target, FloatImage* zbuffer, int x0, int y0, int x1, int y1)
+{
+	const Edge& e0 = tri.edges[0];
+	const Edge& e1 = tri.edges[1];
+	const Edge& e2 = tri.edges[2];
+	long long w0_row = e0.Evaluate(x0, y0);
+	long long w1_row = e1.Evaluate(x0, y0);
+	long long w2_row = e2.Evaluate(x0, y0);
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		Color* row = target.pixels + y * width;
+		float* depth_row = zbuffer ? zbuffer->pixels + y * width : NULL;
+
+		long long w0 = w0_row, w1 = w1_row, w2 = w2_row;
+		float z = tri.z.At(x0, y);
+		float r = tri.rgb[0].At(x0, y);
+		float g = tri.rgb[1].At(x0, y);
+		float b = tri.rgb[2].At(x0, y);
+
+		for (int x = x0; x <= x1; ++x)
+		{
+			if ((w0 | w1 | w2) >= 0 && (!depth_row || z < depth_row[x]))
+			{
+				if (depth_row)
+					depth_row[x] = z;
+				row[x].Set(r, g, b);
+			}
+			w0 += e0.a; w1 += e1.a; w2 += e2.a;
+			z += tri.z.dx;
+			r += tri.rgb[0].dx;
+			g += tri.rgb[1].dx;
+			b += tri.rgb[2].dx;
+		}
+		w0_row += e0.b; w1_row += e1.b; w2_row += e2.b;
+	}
+}
@@ -0,0 +1,79 @@
+/*
+	+ This file defines the TileRasterizer, a half-space (edge function) triangle filler.
+	+ Triangles are set up in fixed point, binned into screen tiles and the tiles are filled in parallel.
+	+ Triangles can also carry a depth and a color per vertex to be depth tested against a FloatImage.
+*/
+
+#pragma once
+
+#include <vector>
+#include "framework.h"
+
+class Image;
+class FloatImage;
+
+class TileRasterizer
+{
+public:
+	static const int TILE_SIZE = 64;		// Tile side in pixels
+	static const int SUBPIXEL_BITS = 4;		// Fixed point precision of the vertices (1/16 of pixel)
+
+	TileRasterizer();
+
+	// Starts a new batch of triangles for a target of size width x height
+	void Begin(unsigned int width, unsigned int height);
+
+	// Adds a filled triangle to the batch, it is clipped against the target bounds
+	void AddTriangle(const Vector2& p0, const Vector2& p1, const Vector2& p2, const Color& c);
+
+	// Adds a triangle with depth (p.z, smaller is closer) and a color per vertex interpolated across the surface
+	void AddTriangle(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Color& c0, const Color& c1, const Color& c2);
+
+	// Fills all the triangles of the batch into the image (in submission order per pixel)
+	// If a zbuffer is given the triangles with depth are only written where they are closer
+	void Flush(Image& target, FloatImage* zbuffer = NULL);
+
+	unsigned int GetTriangleCount() const { return (unsigned int)triangles.size(); }
+
+private:
+	// Edge function E(x,y) = a*x + b*y + c evaluated at pixel centers, inside when E >= 0
+	struct Edge
+	{
+		long long a, b, c;
+		long long Evaluate(int x, int y) const { return a * x + b * y + c; }
+	};
+
+	// Attribute linearly interpolated in screen space: value(x,y) = base + dx*x + dy*y
+	struct Plane
+	{
+		float base, dx, dy;
+		float At(int x, int y) const { return base + dx * x + dy * y; }
+	};
+
+	struct Triangle
+	{
+		int min_x, min_y, max_x, max_y; // Bounding box in pixels (inclusive)
+		Edge edges[3];
+		Color color;
+
+		// Only used by the triangles with depth
+		bool has_depth;
+		Plane z;
+		Plane rgb[3];
+	};
+
+	bool SetupTriangle(const float* x, const float* y, Triangle& tri);
+	void BinTriangle(const Triangle& tri);
+	void RasterizeTile(Image& target, FloatImage* zbuffer, unsigned int tile_index);
+	void RasterizeDepthRect(const Triangle& tri, Image& target, FloatImage* zbuffer, int x0, int y0, int x1, int y1);
+
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<unsigned int>> bins;	// Triangle indices per tile
+	std::vector<unsigned int> active_tiles;			// Tiles with at least one triangle
+	Rect bounds;									// Pixels covered by the bounding boxes of the triangles, marked dirty on the target
+
+	unsigned int width;
+	unsigned int height;
+	int tiles_x;
+	int tiles_y;
+};
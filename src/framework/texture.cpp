@@ -9,6 +9,7 @@ std::map<std::string, Texture*> Texture::s_Textures;
 
 Texture::Texture()
 {
+	texture_id = 0;
 	width = 0;
 	height = 0;
 	format = GL_RGB;
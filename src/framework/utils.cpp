@@ -25,7 +25,12 @@
 
 #include "main/includes.h"
 #include "application.h"
+#include "profiler.h"
 #include "image.h"
+#include "jobsystem.h"
+#include "arena.h"
+#include <chrono>
+#include <thread>
 
 std::string absResPath( const std::string& p_sFile )
 {
@@ -138,9 +143,63 @@ SDL_Window* createWindow(const char* caption, int width, int height )
 	return window;
 }
 
+// Sends an event to the app, returns false when the window was closed
+static bool handleEvent(Application* app, const SDL_Event& sdlEvent)
+{
+	switch(sdlEvent.type)
+		{
+			case SDL_QUIT: return false; break; // EVENT for when the user clicks the [x] in the corner
+			case SDL_MOUSEBUTTONDOWN: // EXAMPLE OF sync mouse input
+				app->OnMouseButtonDown(sdlEvent.button);
+				break;
+			case SDL_MOUSEBUTTONUP:
+				app->OnMouseButtonUp(sdlEvent.button);
+				break;
+			case SDL_MOUSEMOTION:
+				app->OnMouseMove(sdlEvent.button);
+				break;
+			case SDL_KEYUP:  // EXAMPLE OF sync keyboard input
+				app->OnKeyPressed(sdlEvent.key);
+				break;
+			case SDL_MOUSEWHEEL:
+				app->OnWheel(sdlEvent.wheel);
+				break;
+			case SDL_WINDOWEVENT:
+				switch (sdlEvent.window.event) {
+					case SDL_WINDOWEVENT_RESIZED: // Resize OpenGL context
+						std::cout << "window resize" << std::endl;
+						app->SetWindowSize( sdlEvent.window.data1, sdlEvent.window.data2 );
+						break;
+				}
+				break;
+#ifdef WIN32
+			case CDirectoryWatcher::WM_FILE_CHANGED:
+				const char* filename = (const char*)(dir_watcher_data.file_name);
+				app->OnFileChanged(filename);
+				break;
+#endif
+		}
+	return true;
+}
+
+// Sleeps until the deadline, the last SLEEP_MARGIN is spun because the OS can wake a thread up later than asked
+// (SDL already sets the Windows timer resolution to 1 ms)
+static void sleepUntil(std::chrono::steady_clock::time_point deadline)
+{
+	const std::chrono::microseconds SLEEP_MARGIN(2000);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (deadline - now > SLEEP_MARGIN)
+		std::this_thread::sleep_for(deadline - now - SLEEP_MARGIN);
+	while (std::chrono::steady_clock::now() < deadline)
+		std::this_thread::yield();
+}
+
 // The application main loop
 void launchLoop(Application* app)
 {
+	// While idle the loop still wakes up this often, the stats in the title are refreshed
+	const int IDLE_WAIT_MS = 500;
+
 	SDL_Event sdlEvent;
 	Uint32 last_time = SDL_GetTicks();
 	int x,y;
@@ -149,81 +208,106 @@ void launchLoop(Application* app)
 	app->mouse_position.set(static_cast<float>(x), static_cast<float>(y));
 
 	Uint32 start_time = SDL_GetTicks();
+	std::chrono::steady_clock::time_point next_frame = std::chrono::steady_clock::now();
 
 	// Infinite loop
 	while (1)
 	{
-		// Read keyboard state and stored in keystate
-		app->keystate = SDL_GetKeyboardState(NULL);
+		// Nothing changes until some input arrives, the thread sleeps instead of drawing the same frame again
+		if (!app->continuous_rendering && !app->NeedsRedraw())
+			SDL_WaitEventTimeout(NULL, IDLE_WAIT_MS);
 
-		// Clear the window and the depth buffer
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		app->profiler.BeginFrame();
+		unsigned long long allocations = getAllocationCount();
 
-		// Render frame
-		app->Render();
-
-		// Swap between front buffer and back buffer
-		SDL_GL_SwapWindow(app->window);
-
-		// Update events
+		// Update events, before the render so the input shows in this frame
+		ScopedTimer events_timer(app->profiler, Profiler::STAGE_EVENTS);
+		int num_events = 0;
 		while(SDL_PollEvent(&sdlEvent))
 		{
-			switch(sdlEvent.type)
-				{
-					case SDL_QUIT: return; break; // EVENT for when the user clicks the [x] in the corner
-					case SDL_MOUSEBUTTONDOWN: // EXAMPLE OF sync mouse input
-						app->OnMouseButtonDown(sdlEvent.button);
-						break;
-					case SDL_MOUSEBUTTONUP:
-						app->OnMouseButtonUp(sdlEvent.button);
-						break;
-					case SDL_MOUSEMOTION:
-						app->OnMouseMove(sdlEvent.button);
-						break;
-					case SDL_KEYUP:  // EXAMPLE OF sync keyboard input
-						app->OnKeyPressed(sdlEvent.key);
-						break;
-					case SDL_MOUSEWHEEL:
-						app->OnWheel(sdlEvent.wheel);
-						break;
-					case SDL_WINDOWEVENT:
-						switch (sdlEvent.window.event) {
-							case SDL_WINDOWEVENT_RESIZED: // Resize OpenGL context
-								std::cout << "window resize" << std::endl;
-								app->SetWindowSize( sdlEvent.window.data1, sdlEvent.window.data2 );
-								break;
-						}
-						break;
-#ifdef WIN32
-					case CDirectoryWatcher::WM_FILE_CHANGED:
-						const char* filename = (const char*)(dir_watcher_data.file_name);
-						app->OnFileChanged(filename);
-						break;
-#endif
-				}
+			if (!handleEvent(app, sdlEvent))
+				return;
+			num_events++;
 		}
 
+		// Read keyboard state and stored in keystate
+		app->keystate = SDL_GetKeyboardState(NULL);
+
 		// Get mouse position and delta
 		app->mouse_state = SDL_GetMouseState(&x,&y);
 		app->mouse_delta.set( app->mouse_position.x - x, app->window_height - app->mouse_position.y - y );
 		app->mouse_position.set(static_cast<float>(x), static_cast<float>(app->window_height - y));
+		events_timer.Stop();
 
 		// Update logic
-		Uint32 now = SDL_GetTicks();
-		float elapsed_time = (now - last_time) * 0.001f; // 0.001 converts from milliseconds to seconds
-		app->time = (now - start_time) * 0.001f;
-		app->Update(elapsed_time);
-		last_time = now;
+		{
+			ScopedTimer timer(app->profiler, Profiler::STAGE_UPDATE);
+			Uint32 now = SDL_GetTicks();
+			float elapsed_time = (now - last_time) * 0.001f; // 0.001 converts from milliseconds to seconds
+			app->time = (now - start_time) * 0.001f;
+			app->Update(elapsed_time);
+			last_time = now;
+		}
+
+		// Any event may change the preview or the toolbar, without them only what Update changed is drawn
+		app->frame_rendered = app->continuous_rendering || num_events > 0 || app->NeedsRedraw();
+		if (app->frame_rendered)
+		{
+			// Render frame
+			{
+				ScopedTimer timer(app->profiler, Profiler::STAGE_RENDER);
+				app->Render();
+			}
+
+			// Clear the window and the depth buffer, then show the framebuffer
+			{
+				ScopedTimer timer(app->profiler, Profiler::STAGE_PRESENT);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				app->Present();
+			}
+
+			// Swap between front buffer and back buffer
+			{
+				ScopedTimer timer(app->profiler, Profiler::STAGE_SWAP);
+				SDL_GL_SwapWindow(app->window);
+			}
+			app->latency.OnPresented();
+		}
 
 		// Check errors in opengl only when working in debug
 		#ifdef _DEBUG
 			checkGLErrors();
 		#endif
+
+		// The idle wake ups are not frames, they would fill the history of the profiler with samples of nothing
+		if (app->frame_rendered)
+			app->profiler.EndFrame();
+
+		// What the frame took from the arena is given back, the heap should not be touched once the frames are warm
+		frameArena().Reset();
+		app->frame_allocations = (unsigned int)(getAllocationCount() - allocations);
+
+		// Frame cap, the frames are spaced from the deadline of the last one so the rate does not drift
+		// A frame that came too late starts the count again instead of rushing the next ones
+		if (app->max_fps > 0 && app->frame_rendered)
+		{
+			next_frame += std::chrono::microseconds(1000000 / app->max_fps);
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (next_frame < now)
+				next_frame = now;
+			else
+				sleepUntil(next_frame);
+		}
 	}
 
 	return;
 }
 
+void parallelFor(int count, const std::function<void(int)>& callback)
+{
+	JobSystem::Get()->ParallelFor(count, callback);
+}
+
 std::vector<std::string> tokenize(const std::string& source, const char* delimiters, bool process_strings)
 {
 	std::vector<std::string> tokens;
@@ -7,6 +7,7 @@
 #include "framework.h"
 #include "SDL.h"
 #include <string>
+#include <functional>
 
 //General functions **************
 class Application;
@@ -18,6 +19,11 @@ bool checkGLErrors();
 SDL_Window* createWindow(const char* caption, int width, int height);
 void launchLoop(Application* app);
 
+// Calls callback(i) for every i in [0, count) distributing the indices among the threads of the JobSystem
+void parallelFor(int count, const std::function<void(int)>& callback);
+// Lambdas are wrapped by reference, a std::function holding a lambda with many captures would allocate in every call
+template <typename F> inline void parallelFor(int count, const F& callback) { parallelFor(count, std::function<void(int)>([&callback](int i) { callback(i); })); }
+
 //fast random generator
 inline unsigned long frand(void) {          //period 2^96-1
 	unsigned long t;
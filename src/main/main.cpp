@@ -1,10 +1,45 @@
 #include "framework/application.h"
 #include "framework/utils.h"
+#include "framework/benchmark.h"
+#include "framework/headless.h"
+#include "framework/jobsystem.h"
 
 int main(int argc, char **argv)
 {
+	// Number of threads of the parallel loops (the CPU cores by default): --threads N
+	for (int i = 1; i + 1 < argc; ++i)
+		if (strcmp(argv[i], "--threads") == 0)
+			JobSystem::Get()->SetNumThreads(atoi(argv[i + 1]));
+
+	// Benchmarks run without window: ComputerGraphics --bench [name]
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return runBenchmark(argc > 2 ? argv[2] : "all") ? 0 : 1;
+
+	// Offscreen rendering to files, without window: ComputerGraphics --headless [options]
+	if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+		return runHeadless(argc, argv);
+
 	// Launch the app (app is a global variable)
 	Application* app = new Application( "Computer Graphics 2025-26", 1280, 720);
+
+	// Loads every asset before the first frame instead of in the background: --sync-assets
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "--sync-assets") == 0)
+			app->async_assets = false;
+
+	// Draws every frame instead of waiting for input when nothing changes: --continuous
+	// Caps the frame rate: --max-fps N
+	// File where L saves the input latency histograms: --latency-csv file
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--continuous") == 0)
+			app->continuous_rendering = true;
+		if (strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc)
+			app->max_fps = atoi(argv[i + 1]);
+		if (strcmp(argv[i], "--latency-csv") == 0 && i + 1 < argc)
+			app->latency_csv = argv[i + 1];
+	}
+
 	app->Init();
 
 	std::cout << "Starting loop..." << std::endl;